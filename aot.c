@@ -0,0 +1,89 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "aot.h"
+
+#ifndef AOT
+
+// No ROMs compiled in, make aot builds with them
+
+const AotProgram aot_programs[] = { {0, 0, NULL, NULL, NULL, NULL} };
+
+#endif
+
+const AotProgram *aot_find (unsigned long rom, u8 quirks)
+{
+	const AotProgram *p;
+	
+	for (p = aot_programs; p->run != NULL; p++)
+	{
+		if (p->rom == rom && p->quirks == (quirks & QUIRK_OPS))
+		{
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static int aot_valid (const AotProgram *p, Machine *m)
+{
+	// Memory still holds what was compiled
+	
+	const AotSpan *s;
+	
+	for (s = p->spans; s->end != 0; s++)
+	{
+		if (memcmp(&m->memory[s->start], &p->image[s->start - 0x200], s->end - s->start) != 0)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void aot_run (Machine *m, unsigned int left)
+{
+	const AotProgram *p = aot_find(m->rom, m->quirks);
+	unsigned int was;
+	u8 check = 1;
+	
+	if (p == NULL)
+	{
+		threaded_run(m, left);
+		return;
+	}
+	while (left > 0)
+	{
+		if (check && !aot_valid(p, m))
+		{
+			// The game changed its code, the rest of the frame is interpreted
+			threaded_run(m, left);
+			return;
+		}
+		was = left;
+		left = p->run(m, left);
+		if (left == was)
+		{
+			// Not compiled here, one instruction at a time until it is
+			machine_step(m);
+			left--;
+			check = (m->IR & 0xF0FF) == 0xF033 || (m->IR & 0xF0FF) == 0xF055;
+		}
+		else
+		{
+			// Stopped by a write over its code or at an address without code
+			check = 1;
+		}
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef _AOT_H
+#define _AOT_H
+
+#include "machine.h"
+
+/*
+
+Ahead of time compiled ROMs
+
+chip8-aotc follows the code of a ROM from 0x200, every jump, call, return
+site and skip, and writes it out as C: a function per ROM with a label for
+every instruction found, each one the same function of ops.h with its
+operands as constants, so the compiler specializes and optimizes it like
+any other C. Straight code falls through, jumps and calls are gotos, and
+returns and Bnnn go through a switch on PC to the label for it.
+
+The function runs until the budget is spent or it gets to an address it
+has no code for, where aot_run hands over to the interpreter and comes
+back as soon as PC is at compiled code again. Fx33 and Fx55 that write
+over compiled bytes stop it too, and every time it is entered the compiled
+bytes are checked against memory, so code changed by the game, a fork or a
+saved state is only ever run by the interpreter.
+
+	make aot
+	./chip8-headless -headless -engine aot -frames 600 roms/PONG
+
+The quirks the ROM asks for are compiled in as constants, a machine told
+to run it with others is left to the threaded engine. The ROMs compiled
+in are in aot_programs, ended by one with run NULL.
+Without -DAOT there are none and the engine is the threaded one.
+
+*/
+
+typedef struct AotSpan
+{
+	u16 start;
+	u16 end;
+} AotSpan;
+
+typedef struct AotProgram
+{
+	// Hash of the ROM, as in Machine.rom
+	unsigned long rom;
+
+	// Quirks that change ops it was compiled for, see rom_quirks
+	u8 quirks;
+
+	// Bytes of memory compiled, as the ROM has them at load
+	const AotSpan *spans;
+	const u8 *image;
+
+	// Bit a & 7 of code[a >> 3] is set when byte a is part of compiled code
+	const u8 *code;
+
+	// Returns the budget left
+	unsigned int (*run) (Machine *m, unsigned int left);
+} AotProgram;
+
+extern const AotProgram aot_programs[];
+
+// Operands of opcode ir, as instr_decode leaves them, for the ops
+
+#define AOT_IN(ir) (&(Instr) {0, (ir), (ir) & 0xFFF, 0, (ir) >> 8 & 0xF, (ir) >> 4 & 0xF, (ir) & 0xFF, (ir) & 0xF})
+
+// Start of the instruction at a, PC is already there
+
+#define AOT_STEP(a, ir) \
+	if (left == 0) \
+	{ \
+		return 0; \
+	} \
+	left--; \
+	m->IR = (ir); \
+	m->PC = (a) + 1
+
+static inline int aot_hit (const u8 *code, u16 at, int n)
+{
+	// Something in n bytes written from at was compiled
+	
+	while (n-- > 0)
+	{
+		at &= 0xFFF;
+		if (code[at >> 3] >> (at & 7) & 1)
+		{
+			return 1;
+		}
+		at++;
+	}
+	return 0;
+}
+
+const AotProgram *aot_find (unsigned long rom, u8 quirks);
+
+#endif
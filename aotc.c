@@ -0,0 +1,488 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+/*
+
+ROM compiler
+
+Follows the code of every ROM given from 0x200 and writes C for it to
+standard output, see aot.h. Only instructions inside the ROM are compiled,
+and neither 0nnn, which the interpreter runs, nor whatever a Bnnn jumps
+to, which can not be known before it runs. Before the code of each ROM
+goes a list of its subroutines with where they are called from, and every
+basic block starts with a comment.
+
+	./chip8-aotc roms/PONG roms/BRIX > aot_roms.c
+
+*/
+
+#include "aot.h"
+#include "ops.h"
+#include "disasm.h"
+
+// Where an instruction leads, besides PC + 2 for most of them
+
+#define FLOW_NEXT 1
+#define FLOW_SKIP 2
+#define FLOW_JUMP 4
+#define FLOW_CALL 8
+#define FLOW_END 16
+#define FLOW_ODD 32
+
+static const char *op_functions[OP_COUNT] =
+{
+	[OP_CLS] = "op_cls",
+	[OP_RET] = "op_ret",
+	[OP_JP] = "op_jp",
+	[OP_CALL] = "op_call",
+	[OP_SE_BYTE] = "op_se_byte",
+	[OP_SNE_BYTE] = "op_sne_byte",
+	[OP_SE_REG] = "op_se_reg",
+	[OP_LD_BYTE] = "op_ld_byte",
+	[OP_ADD_BYTE] = "op_add_byte",
+	[OP_LD_REG] = "op_ld_reg",
+	[OP_OR] = "op_or",
+	[OP_AND] = "op_and",
+	[OP_XOR] = "op_xor",
+	[OP_ADD_REG] = "op_add_reg",
+	[OP_SUB] = "op_sub",
+	[OP_SHR] = "op_shr",
+	[OP_SUBN] = "op_subn",
+	[OP_SHL] = "op_shl",
+	[OP_SNE_REG] = "op_sne_reg",
+	[OP_LD_I] = "op_ld_i",
+	[OP_JP_V0] = "op_jp_v0",
+	[OP_RND] = "op_rnd",
+	[OP_DRW] = "op_drw",
+	[OP_SKP] = "op_skp",
+	[OP_SKNP] = "op_sknp",
+	[OP_LD_VX_DT] = "op_ld_vx_dt",
+	[OP_LD_KEY] = "op_ld_key",
+	[OP_LD_DT] = "op_ld_dt",
+	[OP_LD_ST] = "op_ld_st",
+	[OP_ADD_I] = "op_add_i",
+	[OP_LD_F] = "op_ld_f",
+	[OP_LD_B] = "op_ld_b",
+	[OP_LD_MEM] = "op_ld_mem",
+	[OP_LD_REG_MEM] = "op_ld_reg_mem",
+	[OP_SCD] = "op_scd",
+	[OP_SCR] = "op_scr",
+	[OP_SCL] = "op_scl",
+	[OP_EXIT] = "op_exit",
+	[OP_LOW] = "op_low",
+	[OP_HIGH] = "op_high",
+	[OP_LD_HF] = "op_ld_hf",
+	[OP_LD_R] = "op_ld_r",
+	[OP_LD_VX_R] = "op_ld_vx_r",
+	[OP_NONE] = "op_none"
+};
+
+typedef struct Rom
+{
+	char *name;
+	unsigned long hash;
+	int size;
+
+	// Quirks that change ops, what rom_quirks gives for it
+	u8 quirks;
+	u8 bytes[ROM_MAX + 1];
+
+	// Instruction decoded at every address, found[a] when there is one
+	Instr code[4096];
+	u8 found[4096];
+
+	// Starts a basic block
+	u8 leader[4096];
+
+	// Reached by a jump, call, skip or the end of a call, from where the first time
+	u8 target[4096];
+	u16 from[4096];
+} Rom;
+
+int flow (Instr *in)
+{
+	switch (in->op)
+	{
+		case OP_JP:
+			return FLOW_JUMP;
+		case OP_CALL:
+			return FLOW_CALL | FLOW_NEXT;
+		case OP_RET:
+		case OP_JP_V0:
+			return FLOW_END;
+		case OP_NONE:
+			// PC is left on its second byte
+			return FLOW_ODD;
+		case OP_SE_BYTE:
+		case OP_SNE_BYTE:
+		case OP_SE_REG:
+		case OP_SNE_REG:
+		case OP_SKP:
+		case OP_SKNP:
+			return FLOW_SKIP | FLOW_NEXT;
+		default:
+			return FLOW_NEXT;
+	}
+}
+
+int inside (Rom *r, int a)
+{
+	return a >= 0x200 && a + 1 < 0x200 + r->size;
+}
+
+void reach (Rom *r, u16 *stack, int *top, int a, int from)
+{
+	// a is where some other instruction goes, not the next one
+	
+	if (a < 4096 && !r->target[a])
+	{
+		r->target[a] = 1;
+		r->from[a] = from;
+	}
+	if (inside(r, a) && !r->found[a])
+	{
+		stack[(*top)++] = a;
+	}
+}
+
+void discover (Rom *r)
+{
+	// Recursive descent from 0x200, with a stack of addresses still to follow
+	
+	u16 stack[4096 * 3];
+	int top = 0, a, f;
+	Instr *in;
+	
+	r->target[0x200] = 1;
+	stack[top++] = 0x200;
+	while (top > 0)
+	{
+		a = stack[--top];
+		while (inside(r, a) && !r->found[a])
+		{
+			in = &r->code[a];
+			instr_decode(in, r->bytes[a - 0x200] << 8 | r->bytes[a - 0x200 + 1]);
+			if (in->op == OP_SYS || in->op == OP_EXIT)
+			{
+				// Left to the interpreter
+				break;
+			}
+			r->found[a] = 1;
+			f = flow(in);
+			if (f & (FLOW_JUMP | FLOW_CALL))
+			{
+				reach(r, stack, &top, in->nnn, a);
+			}
+			if (f & FLOW_SKIP)
+			{
+				reach(r, stack, &top, a + 4, a);
+			}
+			if (f & FLOW_CALL)
+			{
+				reach(r, stack, &top, a + 2, a);
+			}
+			if (f & FLOW_ODD)
+			{
+				reach(r, stack, &top, a + 1, a);
+			}
+			if (!(f & FLOW_NEXT))
+			{
+				break;
+			}
+			a += 2;
+		}
+	}
+	
+	for (a = 0x200; a < 4096; a++)
+	{
+		r->leader[a] = r->found[a] && (r->target[a] || !r->found[a - 2] || !(flow(&r->code[a - 2]) & FLOW_NEXT));
+	}
+}
+
+void print_goto (Rom *r, int a)
+{
+	if (a < 4096 && r->found[a])
+	{
+		printf("goto L%03X;", a);
+	}
+	else
+	{
+		printf("return left;");
+	}
+}
+
+void print_header (Rom *r)
+{
+	int a, b, count = 0, blocks = 0, first;
+	
+	for (a = 0x200; a < 4096; a++)
+	{
+		count += r->found[a];
+		blocks += r->leader[a];
+	}
+	printf("/*\n\n%s, %d bytes, hash 0x%08lX\n", r->name, r->size, r->hash);
+	printf("%d instructions in %d blocks\n\nSubroutines\n\n", count, blocks);
+	for (a = 0x200; a < 4096; a++)
+	{
+		if (!r->found[a] || !r->target[a])
+		{
+			continue;
+		}
+		first = 1;
+		for (b = 0x200; b < 4096; b++)
+		{
+			if (r->found[b] && r->code[b].op == OP_CALL && r->code[b].nnn == a)
+			{
+				if (first)
+				{
+					printf("\t0x%03X\tcalled from 0x%03X", a, b);
+					first = 0;
+				}
+				else
+				{
+					printf(", 0x%03X", b);
+				}
+			}
+		}
+		if (!first)
+		{
+			printf("\n");
+		}
+	}
+	printf("\n*/\n\n");
+}
+
+void print_data (Rom *r)
+{
+	// What aot_run checks memory against, and which bytes are code
+	
+	u8 code[512];
+	int a, start;
+	
+	memset(code, 0, sizeof(code));
+	for (a = 0x200; a < 4096; a++)
+	{
+		if (r->found[a])
+		{
+			code[a >> 3] |= 1 << (a & 7);
+			code[(a + 1) >> 3] |= 1 << ((a + 1) & 7);
+		}
+	}
+	
+	printf("static const u8 image_%08lX[] =\n{", r->hash);
+	for (a = 0; a < r->size; a++)
+	{
+		printf("%s0x%02X,", a % 16 == 0 ? "\n\t" : " ", r->bytes[a]);
+	}
+	printf("\n};\n\nstatic const u8 code_%08lX[512] =\n{", r->hash);
+	for (a = 0; a < 512; a++)
+	{
+		printf("%s0x%02X,", a % 16 == 0 ? "\n\t" : " ", code[a]);
+	}
+	printf("\n};\n\nstatic const AotSpan spans_%08lX[] =\n{\n", r->hash);
+	for (a = 0x200; a < 4096; a++)
+	{
+		if (code[a >> 3] >> (a & 7) & 1)
+		{
+			for (start = a; a < 4096 && (code[a >> 3] >> (a & 7) & 1); a++)
+			{
+			}
+			printf("\t{0x%03X, 0x%03X},\n", start, a);
+		}
+	}
+	printf("\t{0, 0}\n};\n\n");
+}
+
+void print_code (Rom *r)
+{
+	char text[DISASM_MAX];
+	Instr *in;
+	int a, f, next, writes = 0, indirect = 0;
+	
+	for (a = 0x200; a < 4096; a++)
+	{
+		writes |= r->found[a] && (r->code[a].op == OP_LD_B || r->code[a].op == OP_LD_MEM);
+		indirect |= r->found[a] && (r->code[a].op == OP_RET || r->code[a].op == OP_JP_V0);
+	}
+	
+	printf("static unsigned int run_%08lX (Machine *m, unsigned int left)\n{\n", r->hash);
+	if (writes)
+	{
+		printf("\tu16 at;\n\n");
+	}
+	if (indirect)
+	{
+		// Returns and Bnnn come back here
+		printf("dispatch:\n");
+	}
+	printf("\tswitch (m->PC)\n\t{\n");
+	for (a = 0x200; a < 4096; a++)
+	{
+		if (r->found[a])
+		{
+			printf("\t\tcase 0x%03X: goto L%03X;\n", a, a);
+		}
+	}
+	printf("\t\tdefault: return left;\n\t}\n");
+	
+	for (a = 0x200; a < 4096; a++)
+	{
+		if (!r->found[a])
+		{
+			continue;
+		}
+		in = &r->code[a];
+		f = flow(in);
+		if (r->leader[a])
+		{
+			if (r->from[a] != 0)
+			{
+				printf("\n\t// Block 0x%03X, from 0x%03X\n", a, r->from[a]);
+			}
+			else
+			{
+				printf("\n\t// Block 0x%03X\n", a);
+			}
+		}
+		disasm(in->ir, text);
+		printf("L%03X:\t// %s\n", a, text);
+		printf("\tAOT_STEP(0x%03X, 0x%04X);\n", a, in->ir);
+		if (in->op == OP_LD_B || in->op == OP_LD_MEM)
+		{
+			printf("\tat = m->I;\n");
+		}
+		if (op_quirk(in->op))
+		{
+			printf("\t%s(m, AOT_IN(0x%04X), %d);\n", op_functions[in->op], in->ir, r->quirks & op_quirk(in->op));
+		}
+		else
+		{
+			printf("\t%s(m, AOT_IN(0x%04X));\n", op_functions[in->op], in->ir);
+		}
+		
+		// Where it goes from here, PC is there already
+		switch (in->op)
+		{
+			case OP_LD_B:
+			case OP_LD_MEM:
+				printf("\tif (aot_hit(code_%08lX, at, %d))\n\t{\n\t\treturn left;\n\t}\n", r->hash, in->op == OP_LD_B ? 3 : in->x + 1);
+				break;
+			case OP_LD_KEY:
+				// Waiting runs it again and again until the end of the frame, nothing changes
+				printf("\tif (m->waiting)\n\t{\n\t\treturn 0;\n\t}\n");
+				break;
+			case OP_NONE:
+				printf("\t");
+				print_goto(r, a + 1);
+				printf("\n");
+				continue;
+			case OP_RET:
+			case OP_JP_V0:
+				printf("\tgoto dispatch;\n");
+				continue;
+		}
+		if (f & FLOW_SKIP)
+		{
+			printf("\tif (m->PC == 0x%03X)\n\t{\n\t\t", a + 4);
+			print_goto(r, a + 4);
+			printf("\n\t}\n");
+		}
+		next = (f & FLOW_JUMP) || (f & FLOW_CALL) ? in->nnn : a + 2;
+		if (next != a + 2 || !r->found[a + 2])
+		{
+			printf("\t");
+			print_goto(r, next);
+			printf("\n");
+		}
+	}
+	printf("}\n\n");
+}
+
+int read_file (Rom *r, char *name)
+{
+	FILE *file = fopen(name, "rb");
+	
+	if (file == NULL)
+	{
+		return LOAD_MISSING;
+	}
+	r->name = name;
+	r->size = fread(r->bytes, 1, sizeof(r->bytes), file);
+	fclose(file);
+	if (r->size > ROM_MAX)
+	{
+		return LOAD_TOO_BIG;
+	}
+	r->hash = rom_hash(r->bytes, r->size);
+	r->quirks = rom_quirks(r->hash) & QUIRK_OPS;
+	memset(r->found, 0, sizeof(r->found));
+	memset(r->leader, 0, sizeof(r->leader));
+	memset(r->target, 0, sizeof(r->target));
+	memset(r->from, 0, sizeof(r->from));
+	return LOAD_OK;
+}
+
+int main(int argv, char *argc[])
+{
+	static Rom r;
+	unsigned long *done;
+	u8 *quirks;
+	int arg, count = 0, i;
+	
+	if (argv < 2)
+	{
+		printf("Usage: %s rom... > file.c\n", argc[0]);
+		return 1;
+	}
+	done = malloc(argv * sizeof(unsigned long));
+	quirks = malloc(argv);
+	if (done == NULL || quirks == NULL)
+	{
+		return 1;
+	}
+	
+	printf("// Written by chip8-aotc, see aot.h\n\n#include \"aot.h\"\n#include \"ops.h\"\n\n");
+	for (arg = 1; arg < argv; arg++)
+	{
+		if (read_file(&r, argc[arg]) != LOAD_OK)
+		{
+			fprintf(stderr, "Skipping %s\n", argc[arg]);
+			continue;
+		}
+		for (i = 0; i < count && done[i] != r.hash; i++)
+		{
+		}
+		if (i < count)
+		{
+			// Same ROM under another name
+			continue;
+		}
+		quirks[count] = r.quirks;
+		done[count++] = r.hash;
+		discover(&r);
+		print_header(&r);
+		print_data(&r);
+		print_code(&r);
+	}
+	
+	printf("const AotProgram aot_programs[] =\n{\n");
+	for (i = 0; i < count; i++)
+	{
+		printf("\t{0x%08lX, %d, spans_%08lX, image_%08lX, code_%08lX, run_%08lX},\n", done[i], quirks[i], done[i], done[i], done[i], done[i]);
+	}
+	printf("\t{0, 0, NULL, NULL, NULL, NULL}\n};\n");
+	free(done);
+	free(quirks);
+	return 0;
+}
@@ -0,0 +1,589 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "batch.h"
+#include "ops.h"
+
+// Bytes in the widest vector the host has, every register of WIDTH lanes
+
+#ifdef __AVX2__
+#define VECTOR 32
+#else
+#define VECTOR 16
+#endif
+#define WIDTH (VECTOR / 2)
+
+typedef u16 vword __attribute__ ((vector_size (VECTOR)));
+
+// Vector of the lanes starting at c
+
+#define LANES(p, c) ((vword *)((p) + (c)))
+
+// a where on is all ones, b where it is 0
+
+#define PICK(on, a, b) (((a) & (on)) | ((b) & ~(on)))
+
+int batch_init (Batch *b, int lanes, char *game_name)
+{
+	// Every machine with the game loaded, seeded l + 1
+	
+	size_t size;
+	u8 *p;
+	int l, k;
+	
+	memset(b, 0, sizeof(*b));
+	b->lanes = lanes;
+	b->size = (lanes + BATCH_CHUNK - 1) / BATCH_CHUNK * BATCH_CHUNK;
+	b->ipf = CLOCK;
+	
+	b->words = (b->size / WIDTH + 63) / 64;
+	
+	b->lane = malloc(b->size * sizeof(Machine));
+	size = b->size * (23 * sizeof(u16) + sizeof(u32));
+	b->block = calloc(1, size + 64);
+	b->at = calloc(4096 * b->words, sizeof(u64));
+	if (b->lane == NULL || b->block == NULL || b->at == NULL)
+	{
+		free(b->lane);
+		free(b->block);
+		free(b->at);
+		return 0;
+	}
+	
+	// Every row starts aligned, the sizes are multiples of BATCH_CHUNK
+	p = (u8 *)(((uintptr_t)b->block + 63) & ~(uintptr_t)63);
+	for (k = 0; k < 16; k++)
+	{
+		b->V[k] = (u16 *)p;
+		p += b->size * sizeof(u16);
+	}
+	b->PC = (u16 *)p;
+	p += b->size * sizeof(u16);
+	b->IR = (u16 *)p;
+	p += b->size * sizeof(u16);
+	b->I = (u16 *)p;
+	p += b->size * sizeof(u16);
+	b->DT = (u16 *)p;
+	p += b->size * sizeof(u16);
+	b->ST = (u16 *)p;
+	p += b->size * sizeof(u16);
+	b->keys = (u16 *)p;
+	p += b->size * sizeof(u16);
+	b->left = (u16 *)p;
+	p += b->size * sizeof(u16);
+	b->more = (u32 *)p;
+	
+	// Loaded once, the rest are copies
+	machine_init(&b->lane[0]);
+	if (read_rom(&b->lane[0]) != LOAD_OK || read_game(&b->lane[0], game_name) != LOAD_OK)
+	{
+		batch_free(b);
+		return 0;
+	}
+	for (l = 0; l < b->size; l++)
+	{
+		if (l > 0)
+		{
+			memcpy(&b->lane[l], &b->lane[0], sizeof(Machine));
+		}
+		machine_seed(&b->lane[l], l + 1);
+		b->PC[l] = b->lane[l].PC;
+		b->IR[l] = b->lane[l].IR;
+	}
+	memset(b->shared, 1, sizeof(b->shared));
+	for (k = 0; k < 2048; k++)
+	{
+		b->code[k].op = OP_DECODE;
+	}
+	return 1;
+}
+
+void batch_free (Batch *b)
+{
+	free(b->lane);
+	free(b->block);
+	free(b->at);
+	b->lane = NULL;
+	b->block = NULL;
+	b->at = NULL;
+}
+
+Machine *batch_sync (Batch *b, int lane)
+{
+	// Registers of lane into its Machine, the rest is always there (waiting only changes in machine_step)
+	
+	Machine *m = &b->lane[lane];
+	int k;
+	
+	for (k = 0; k < 16; k++)
+	{
+		m->V[k] = b->V[k][lane];
+	}
+	m->PC = b->PC[lane];
+	m->IR = b->IR[lane];
+	m->I = b->I[lane];
+	m->DT = b->DT[lane];
+	m->ST = b->ST[lane];
+	return m;
+}
+
+static void lane_step (Batch *b, int l)
+{
+	// One instruction of lane l on its own, as machine_run would
+	
+	Machine *m = &b->lane[l];
+	u16 a = b->PC[l] & 0xFFF;
+	u16 ir = m->memory[a] << 8 | m->memory[(a + 1) & 0xFFF];
+	u16 i = b->I[l];
+	u8 x = (ir >> 8) & 0xF, y = (ir >> 4) & 0xF;
+	u8 k, all = (ir & 0xF0FF) == 0xF055 || (ir & 0xF0FF) == 0xF065 || (ir & 0xF0FF) == 0xF075 || (ir & 0xF0FF) == 0xF085;
+	
+	// No instruction touches other registers than these
+	m->V[0] = b->V[0][l];
+	m->V[x] = b->V[x][l];
+	m->V[y] = b->V[y][l];
+	m->V[0xF] = b->V[0xF][l];
+	for (k = 0; all && k <= x; k++)
+	{
+		m->V[k] = b->V[k][l];
+	}
+	m->PC = b->PC[l];
+	m->I = i;
+	m->DT = b->DT[l];
+	m->ST = b->ST[l];
+	
+	machine_step(m);
+	
+	b->V[x][l] = m->V[x];
+	b->V[0xF][l] = m->V[0xF];
+	for (k = 0; all && k <= x; k++)
+	{
+		b->V[k][l] = m->V[k];
+	}
+	b->PC[l] = m->PC;
+	b->IR[l] = m->IR;
+	b->I[l] = m->I;
+	b->DT[l] = m->DT;
+	b->ST[l] = m->ST;
+	b->left[l]--;
+	
+	// Fx0A with no key only runs itself again until the frame ends
+	if (m->waiting && m->keys == 0)
+	{
+		b->left[l] = 0;
+		b->more[l] = 0;
+	}
+	
+	// Where it wrote is no longer the same in every machine
+	if ((ir & 0xF0FF) == 0xF033 || (ir & 0xF0FF) == 0xF055)
+	{
+		for (k = 0; k <= ((ir & 0xFF) == 0x33 ? 2 : x); k++)
+		{
+			b->shared[(i + k) & 0xFFF] = 0;
+		}
+	}
+}
+
+static int lockstep (u8 op)
+{
+	// Instructions run on a whole vector at once
+	
+	switch (op)
+	{
+		case OP_JP:
+		case OP_SE_BYTE:
+		case OP_SNE_BYTE:
+		case OP_SE_REG:
+		case OP_LD_BYTE:
+		case OP_ADD_BYTE:
+		case OP_LD_REG:
+		case OP_OR:
+		case OP_AND:
+		case OP_XOR:
+		case OP_ADD_REG:
+		case OP_SUB:
+		case OP_SHR:
+		case OP_SUBN:
+		case OP_SHL:
+		case OP_SNE_REG:
+		case OP_LD_I:
+		case OP_JP_V0:
+		case OP_SKP:
+		case OP_SKNP:
+		case OP_LD_VX_DT:
+		case OP_LD_DT:
+		case OP_LD_ST:
+		case OP_ADD_I:
+		case OP_LD_F:
+		case OP_NONE:
+			return 1;
+	}
+	return 0;
+}
+
+static ALWAYS_INLINE void vector_execute (Batch *b, Instr *in, int c, vword on, const u8 quirks)
+{
+	// in on the lanes from c where on is set, the same as ops.h does
+	
+	vword *vx = LANES(b->V[in->x], c);
+	vword *vy = LANES(b->V[in->y], c);
+	vword *vs = (quirks & QUIRK_SHIFT_VY) ? vy : vx;
+	vword *vf = LANES(b->V[0xF], c);
+	vword *pc = LANES(b->PC, c);
+	vword *i = LANES(b->I, c);
+	vword z, skip;
+	int k;
+	
+	// VF is written first and Vx read after it, as the ops do when x is F
+	switch (in->op)
+	{
+		case OP_JP:
+			*pc = PICK(on, (vword){0} + in->nnn, *pc);
+			return;
+		case OP_JP_V0:
+			*pc = PICK(on, *LANES(b->V[(quirks & QUIRK_JUMP_VX) ? in->x : 0], c) + in->nnn, *pc);
+			return;
+		case OP_NONE:
+			// Only the fetch moved PC
+			*pc = PICK(on, *pc + 1, *pc);
+			return;
+		case OP_SE_BYTE:
+			skip = (vword)(*vx == in->kk);
+			*pc = PICK(on, *pc + 2 + (skip & 2), *pc);
+			return;
+		case OP_SNE_BYTE:
+			skip = (vword)(*vx != in->kk);
+			*pc = PICK(on, *pc + 2 + (skip & 2), *pc);
+			return;
+		case OP_SE_REG:
+			skip = (vword)(*vx == *vy);
+			*pc = PICK(on, *pc + 2 + (skip & 2), *pc);
+			return;
+		case OP_SNE_REG:
+			skip = (vword)(*vx != *vy);
+			*pc = PICK(on, *pc + 2 + (skip & 2), *pc);
+			return;
+		case OP_SKP:
+		case OP_SKNP:
+			// No shift by a different amount in every lane before AVX-512
+			for (k = 0; k < WIDTH; k++)
+			{
+				skip[k] = ((*vx)[k] < 16 && ((b->keys[c + k] >> (*vx)[k]) & 1)) ? 0xFFFF : 0;
+			}
+			if (in->op == OP_SKNP)
+			{
+				skip = ~skip;
+			}
+			*pc = PICK(on, *pc + 2 + (skip & 2), *pc);
+			return;
+		case OP_LD_BYTE:
+			*vx = PICK(on, (vword){0} + in->kk, *vx);
+			break;
+		case OP_ADD_BYTE:
+			*vx = PICK(on, (*vx + in->kk) & 0xFF, *vx);
+			break;
+		case OP_LD_REG:
+			*vx = PICK(on, *vy, *vx);
+			break;
+		case OP_OR:
+			*vx = PICK(on, *vx | *vy, *vx);
+			break;
+		case OP_AND:
+			*vx = PICK(on, *vx & *vy, *vx);
+			break;
+		case OP_XOR:
+			*vx = PICK(on, *vx ^ *vy, *vx);
+			break;
+		case OP_ADD_REG:
+			z = *vx + *vy;
+			*vf = PICK(on, z >> 8, *vf);
+			*vx = PICK(on, z & 0xFF, *vx);
+			break;
+		case OP_SUB:
+			*vf = PICK(on, (vword)(*vx > *vy) & 1, *vf);
+			*vx = PICK(on, (*vx - *vy) & 0xFF, *vx);
+			break;
+		case OP_SHR:
+			*vf = PICK(on, *vs & 1, *vf);
+			*vx = PICK(on, *vs >> 1, *vx);
+			break;
+		case OP_SUBN:
+			*vf = PICK(on, (vword)(*vy > *vx) & 1, *vf);
+			*vx = PICK(on, (*vx - *vy) & 0xFF, *vx);
+			break;
+		case OP_SHL:
+			*vf = PICK(on, *vs >> 7, *vf);
+			*vx = PICK(on, (*vs << 1) & 0xFF, *vx);
+			break;
+		case OP_LD_I:
+			*i = PICK(on, (vword){0} + in->nnn, *i);
+			break;
+		case OP_ADD_I:
+			*i = PICK(on, *i + *vx, *i);
+			break;
+		case OP_LD_F:
+			*i = PICK(on, *vx * 5, *i);
+			break;
+		case OP_LD_VX_DT:
+			*vx = PICK(on, *LANES(b->DT, c) & 0xFF, *vx);
+			break;
+		case OP_LD_DT:
+			*LANES(b->DT, c) = PICK(on, *vx, *LANES(b->DT, c));
+			break;
+		case OP_LD_ST:
+			*LANES(b->ST, c) = PICK(on, *vx, *LANES(b->ST, c));
+			break;
+	}
+	*pc = PICK(on, *pc + 2, *pc);
+}
+
+static inline int none (vword v)
+{
+	// No lane set
+	
+	u64 q[VECTOR / 8];
+	int k;
+	
+	memcpy(q, &v, sizeof(q));
+	for (k = 1; k < VECTOR / 8; k++)
+	{
+		q[0] |= q[k];
+	}
+	return q[0] == 0;
+}
+
+static inline void vector_busy (Batch *b, u16 a)
+{
+	// Some vector has a lane at a
+	
+	b->busy[a >> 6] |= (u64)1 << (a & 63);
+	b->busy_words |= (u64)1 << (a >> 6);
+}
+
+static inline void vector_at (Batch *b, int v, u16 a)
+{
+	// Vector v has a lane at a
+	
+	b->at[a * b->words + (v >> 6)] |= (u64)1 << (v & 63);
+	vector_busy(b, a);
+}
+
+static inline void vector_put (Batch *b, int v, vword live, u16 guess)
+{
+	// The lanes of vector v set in live at their addresses, most often all at guess
+	
+	vword pc = *LANES(b->PC, v * WIDTH) & 0xFFF;
+	vword same;
+	u16 at = guess;
+	int k;
+	
+	for (;;)
+	{
+		same = (vword)(pc == at);
+		if (!none(live & same))
+		{
+			vector_at(b, v, at);
+		}
+		live &= ~same;
+		if (none(live))
+		{
+			return;
+		}
+		for (k = 0; !live[k]; k++)
+		{
+		}
+		at = pc[k];
+	}
+}
+
+static inline int lowest (Batch *b, u16 *a)
+{
+	// The lowest address with lanes, 0 when none is left
+	
+	int w;
+	
+	if (b->busy_words == 0)
+	{
+		return 0;
+	}
+	w = __builtin_ctzll(b->busy_words);
+	*a = w << 6 | __builtin_ctzll(b->busy[w]);
+	b->busy[w] &= b->busy[w] - 1;
+	if (b->busy[w] == 0)
+	{
+		b->busy_words &= ~((u64)1 << w);
+	}
+	return 1;
+}
+
+static int refill (Batch *b)
+{
+	// Frames longer than 65535 instructions go in parts, 0 when all is done
+	
+	int l, again = 0;
+	
+	for (l = 0; l < b->lanes; l++)
+	{
+		b->left[l] = b->more[l] > 0xFFFF ? 0xFFFF : b->more[l];
+		b->more[l] -= b->left[l];
+		again |= b->left[l] != 0;
+	}
+	return again;
+}
+
+static ALWAYS_INLINE void batch_core (Batch *b, const u8 quirks)
+{
+	// A frame of every machine, the lanes all have the quirks of the first
+	
+	Machine *m;
+	Instr decoded, *in;
+	vword on, live;
+	u64 vectors, went;
+	u16 a, next;
+	int c, k, l, w;
+	u8 together;
+	
+	for (l = 0; l < b->size; l++)
+	{
+		m = &b->lane[l];
+		b->more[l] = 0;
+		b->keys[l] = m->keys;
+		if (l >= b->lanes || (m->waiting && m->keys == 0))
+		{
+			continue;
+		}
+		b->more[l] = b->ipf;
+#ifndef NO_IDLE_LOOPS
+		batch_sync(b, l);
+		if (machine_idle(m, b->ipf))
+		{
+			for (k = 0; k < 16; k++)
+			{
+				b->V[k][l] = m->V[k];
+			}
+			b->PC[l] = m->PC;
+			b->IR[l] = m->IR;
+			b->more[l] = 0;
+		}
+#endif
+	}
+	
+	while (refill(b))
+	{
+		for (c = 0; c < b->size; c += WIDTH)
+		{
+			live = (vword)(*LANES(b->left, c) != 0);
+			if (!none(live))
+			{
+				vector_put(b, c / WIDTH, live, b->PC[c] & 0xFFF);
+			}
+		}
+		while (lowest(b, &a))
+		{
+			// Same bytes at a in every machine, or each runs its own
+			together = b->shared[a] && b->shared[(a + 1) & 0xFFF];
+			in = NULL;
+			if (together)
+			{
+				if (a & 1)
+				{
+					in = &decoded;
+					instr_decode(in, b->lane[0].memory[a] << 8 | b->lane[0].memory[(a + 1) & 0xFFF]);
+				}
+				else
+				{
+					in = &b->code[a >> 1];
+					if (in->op == OP_DECODE)
+					{
+						instr_decode(in, b->lane[0].memory[a] << 8 | b->lane[0].memory[a + 1]);
+					}
+				}
+				together = lockstep(in->op);
+			}
+			
+			// Where the lanes most likely go
+			next = (together && in->op == OP_JP) ? in->nnn : (a + 2) & 0xFFF;
+			
+			// Only the vectors with lanes at a, each to where its lanes went
+			for (w = 0; w < b->words; w++)
+			{
+				vectors = b->at[a * b->words + w];
+				b->at[a * b->words + w] = 0;
+				went = 0;
+				for (; vectors != 0; vectors &= vectors - 1)
+				{
+					c = (w * 64 + __builtin_ctzll(vectors)) * WIDTH;
+					on = (vword)(*LANES(b->left, c) != 0) & (vword)((*LANES(b->PC, c) & 0xFFF) == a);
+					if (together)
+					{
+						vector_execute(b, in, c, on, quirks);
+						*LANES(b->IR, c) = PICK(on, (vword){0} + in->ir, *LANES(b->IR, c));
+						*LANES(b->left, c) += on;
+					}
+					else
+					{
+						for (k = 0; k < WIDTH; k++)
+						{
+							if (on[k])
+							{
+								lane_step(b, c + k);
+							}
+						}
+					}
+					live = on & (vword)(*LANES(b->left, c) != 0);
+					if (none(live))
+					{
+					}
+					else if (none(live & (vword)((*LANES(b->PC, c) & 0xFFF) != next)))
+					{
+						went |= vectors & -vectors;
+					}
+					else
+					{
+						vector_put(b, c / WIDTH, live, next);
+					}
+				}
+				if (went != 0)
+				{
+					b->at[next * b->words + w] |= went;
+					vector_busy(b, next);
+				}
+			}
+		}
+	}
+	
+	// Timers stop at 0
+	for (c = 0; c < b->size; c += WIDTH)
+	{
+		*LANES(b->DT, c) += (vword)(*LANES(b->DT, c) != 0);
+		*LANES(b->ST, c) += (vword)(*LANES(b->ST, c) != 0);
+	}
+	for (l = 0; l < b->lanes; l++)
+	{
+		b->lane[l].frame++;
+	}
+}
+
+// Built once for every set of quirks that change ops, see QUIRK_EACH in ops.h
+
+#define BATCH_RUN(q) static void batch_run_##q (Batch *b) { batch_core(b, q); }
+
+QUIRK_EACH(BATCH_RUN)
+
+static void (* const batch_runs[QUIRK_SETS]) (Batch *b) = QUIRK_TABLE(batch_run);
+
+void batch_run (Batch *b)
+{
+	batch_runs[b->lane[0].quirks & QUIRK_OPS](b);
+}
@@ -0,0 +1,85 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include "machine.h"
+
+/*
+
+Batch
+
+Many machines running the same game, each with its own keys and seed, kept
+structure of arrays: V0 of every machine together, then V1, and so on, the
+same for PC, I and the timers. A frame runs them all in lockstep. Every
+step takes the lowest PC among the machines with instructions left and runs
+that instruction on every machine there at once. Each address keeps a bit
+for every vector with a machine there, so a step only visits the vectors
+it runs, however far apart the rest are. For the register, compare
+and key instructions (6xkk, 7xkk, 8xy*, 3xkk, 4xkk, 5xy0, 9xy0, Ex9E,
+ExA1), the jumps but CALL and RET, Annn, Fx1E, Fx29 and the timers, that
+is a handful of vector operations for 8 machines, or 16 with -mavx2, using
+GCC vector extensions. Every register is kept 16 bits wide so they all fit
+the same vectors. Anything else, or code some machine wrote over, is run by
+machine_step on each machine in turn.
+
+Machines that are in different places wait for the lowest one, and each
+one still runs exactly ipf instructions a frame in its own order, so
+every machine ends up exactly as a Machine run alone.
+
+The rest of each machine (memory, stack, screen, keys, random numbers) is
+in its own Machine in lane[]. Set keys there before batch_run. Use
+batch_sync before reading anything else from it.
+
+*/
+
+// Lanes are allocated in multiples of it, a vector of any width fits
+
+#define BATCH_CHUNK 32
+
+typedef struct Batch
+{
+	// Machines asked for, and allocated
+	int lanes;
+	int size;
+	
+	Machine *lane;
+	
+	// The registers of every machine, lane l at [l], V too 16 bits wide
+	u16 *V[16];
+	u16 *PC;
+	u16 *IR;
+	u16 *I;
+	u16 *DT;
+	u16 *ST;
+	
+	// Copied from lane[] when a frame starts
+	u16 *keys;
+	
+	// Instructions left in this frame, those past 65535 wait in more
+	u16 *left;
+	u32 *more;
+	
+	// For every PC & 0xFFF the vectors with a machine there that has
+	// instructions left, words bits at a time, and a bit for each address
+	// with any in busy, and for each word of busy not 0 in busy_words
+	u64 *at;
+	int words;
+	u64 busy[64];
+	u64 busy_words;
+	
+	unsigned int ipf;
+	
+	// 1 while no machine has written the byte, so it is the same in all of them
+	u8 shared[4096];
+	
+	// Decoded instruction for every even address, only used where shared
+	Instr code[2048];
+	
+	void *block;
+} Batch;
+
+int batch_init (Batch *b, int lanes, char *game_name);
+void batch_run (Batch *b);
+Machine *batch_sync (Batch *b, int lane);
+void batch_free (Batch *b);
+
+#endif
@@ -0,0 +1,418 @@
+/*
+
+Chip-8 Emulator - Pinocho
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/*
+
+Benchmark
+
+Runs every ROM given for a fixed number of frames, unthrottled and without
+a window, pressing the keys in a fixed pattern and with a fixed seed, so
+two runs of the same build do exactly the same work. One line per ROM and
+engine with the speed and the memory used, as CSV or JSON, to keep as a
+baseline and compare later builds against.
+
+Every ROM runs in a process of its own, so the peak RSS is its own and a
+ROM that stops at an unknown opcode does not stop the rest.
+
+	make -s bench > baseline.csv
+	make -s bench BENCHFLAGS="-json -engine jit" > jit.json
+	./chip8-bench -input session.txt roms/PONG
+
+make bench runs 600 frames of every ROM, the defaults here are the full
+run, minutes long. -input plays a script or a recording of chip8 instead
+of the fixed pattern, the batch lanes each shifted by a few frames.
+
+Instructions are the ones the machine ran, ipf for every frame not waiting
+at Fx0A, also when an idle loop is worked out at once instead of run. For
+the batch engine frames and instructions are those of all its machines.
+
+*/
+
+#include "machine.h"
+#include "script.h"
+#include "sched.h"
+#include "batch.h"
+#include "aot.h"
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+// Defaults, about 5 minutes of game time at a speed that keeps the host busy
+
+#define BENCH_FRAMES 20000
+#define BENCH_IPF 1000
+#define BENCH_SEED 1
+
+// The batch engine runs this many copies of the ROM, each with its own keys and seed
+
+#define BENCH_LANES 32
+#define BENCH_BATCH 5
+
+typedef struct Result
+{
+	unsigned long frames;
+	unsigned long long instructions;
+	double seconds;
+	long peak_kb;
+} Result;
+
+static const char *engine_names[] = { "switch", "cache", "threaded", "jit", "aot", "batch" };
+
+// Keys of every frame from -input, NULL for the fixed pattern
+
+static u16 *script_table;
+static unsigned long script_frames;
+
+void usage(char *name)
+{
+	printf("Usage: %s [options] rom...\n", name);
+	printf("  -frames n      frames for every ROM, %d by default\n", BENCH_FRAMES);
+	printf("  -ipf n         instructions per frame, %d by default\n", BENCH_IPF);
+	printf("  -seed n        seed for random numbers, %d by default\n", BENCH_SEED);
+	printf("  -input file    keys from a script or a recording, -s for short\n");
+	printf("  -engine name   switch, cache, threaded, jit, aot, batch or all (default)\n");
+	printf("  -lanes n       machines run together by batch, %d by default\n", BENCH_LANES);
+	printf("  -json          JSON instead of CSV\n");
+}
+
+u16 bench_keys(unsigned long frame)
+{
+	// Every key in turn, down for 20 frames and up for 10, unless a script was given
+	
+	if (script_table != NULL)
+	{
+		return script_table[frame < script_frames ? frame : script_frames - 1];
+	}
+	if (frame % 30 >= 20)
+	{
+		return 0;
+	}
+	return 1 << ((frame / 30 * 5) % 16);
+}
+
+void bench_batch(char *rom, int lanes, unsigned long frames, unsigned int ipf, u32 seed, Result *r)
+{
+	// Lane l plays frame f with the keys of frame f + 7 l, so they go apart
+	
+	Batch b;
+	double start;
+	unsigned long i;
+	int l;
+	
+	if (!batch_init(&b, lanes, rom))
+	{
+		exit(1);
+	}
+	b.ipf = ipf;
+	for (l = 0; l < lanes; l++)
+	{
+		machine_seed(&b.lane[l], seed + l);
+	}
+	
+	r->instructions = 0;
+	start = sched_now();
+	for (i = 0; i < frames; i++)
+	{
+		for (l = 0; l < lanes; l++)
+		{
+			b.lane[l].keys = bench_keys(i + 7 * l);
+			if (!(b.lane[l].waiting && b.lane[l].keys == 0))
+			{
+				r->instructions += ipf;
+			}
+		}
+		batch_run(&b);
+	}
+	r->seconds = sched_now() - start;
+	r->frames = frames * lanes;
+	batch_free(&b);
+}
+
+void bench_rom(char *rom, u8 engine, int lanes, unsigned long frames, unsigned int ipf, u32 seed, Result *r)
+{
+	// Runs in the child, the parent only gets r
+	
+	Machine *m;
+	struct rusage usage;
+	double start;
+	unsigned long i;
+	
+	if (engine == BENCH_BATCH)
+	{
+		bench_batch(rom, lanes, frames, ipf, seed, r);
+		getrusage(RUSAGE_SELF, &usage);
+		r->peak_kb = usage.ru_maxrss;
+		return;
+	}
+	
+	m = malloc(sizeof(Machine));
+	if (m == NULL)
+	{
+		exit(1);
+	}
+	machine_init(m);
+	machine_seed(m, seed);
+	m->engine = engine;
+	m->ipf = ipf;
+	load_rom(m);
+	load_game(m, rom);
+	
+	r->instructions = 0;
+	start = sched_now();
+	for (i = 0; i < frames; i++)
+	{
+		m->keys = bench_keys(m->frame);
+		if (!(m->waiting && m->keys == 0))
+		{
+			r->instructions += m->ipf;
+		}
+		machine_run(m);
+	}
+	r->seconds = sched_now() - start;
+	r->frames = frames;
+	
+	// Linux gives it in KB
+	getrusage(RUSAGE_SELF, &usage);
+	r->peak_kb = usage.ru_maxrss;
+	machine_free(m);
+	free(m);
+}
+
+int bench_script(char *input_name, unsigned long frames, u32 *seed, u8 has_seed)
+{
+	// Read the keys of all frames once, before the children are forked
+	
+	Script script;
+	unsigned long f;
+	
+	if (!script_open(&script, input_name))
+	{
+		return 0;
+	}
+	script_table = malloc(frames * sizeof(u16));
+	if (script_table == NULL)
+	{
+		script_close(&script);
+		return 0;
+	}
+	script_frames = frames;
+	for (f = 0; f < frames; f++)
+	{
+		script_table[f] = script_keys(&script, f);
+	}
+	if (!has_seed && script.has_seed)
+	{
+		*seed = script.seed;
+	}
+	script_close(&script);
+	return 1;
+}
+
+int bench_fork(char *rom, u8 engine, int lanes, unsigned long frames, unsigned int ipf, u32 seed, Result *r)
+{
+	// 1 when the child got to the end
+	
+	int fd[2], status, ok;
+	pid_t pid;
+	
+	if (pipe(fd) != 0)
+	{
+		return 0;
+	}
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+	{
+		close(fd[0]);
+		close(fd[1]);
+		return 0;
+	}
+	if (pid == 0)
+	{
+		// What the machine prints would get in the middle of the results
+		close(fd[0]);
+		if (freopen("/dev/null", "w", stdout) == NULL)
+		{
+			_exit(1);
+		}
+		bench_rom(rom, engine, lanes, frames, ipf, seed, r);
+		ok = write(fd[1], r, sizeof(Result)) == sizeof(Result);
+		_exit(ok ? 0 : 1);
+	}
+	close(fd[1]);
+	ok = read(fd[0], r, sizeof(Result)) == sizeof(Result);
+	close(fd[0]);
+	waitpid(pid, &status, 0);
+	return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void print_result(char *rom, u8 engine, Result *r, u8 json, u8 first)
+{
+	double ips = r->seconds > 0 ? r->instructions / r->seconds : 0;
+	double fps = r->seconds > 0 ? r->frames / r->seconds : 0;
+	double ns = r->instructions > 0 ? r->seconds * 1e9 / r->instructions : 0;
+	char *name = strrchr(rom, '/') != NULL ? strrchr(rom, '/') + 1 : rom;
+	
+	if (json)
+	{
+		printf("%s\n  {\"rom\": \"%s\", \"engine\": \"%s\", \"frames\": %lu, \"instructions\": %llu, "
+			"\"seconds\": %.6f, \"instructions_per_second\": %.0f, \"frames_per_second\": %.1f, "
+			"\"ns_per_instruction\": %.3f, \"peak_rss_kb\": %ld}",
+			first ? "" : ",", name, engine_names[engine], r->frames, r->instructions,
+			r->seconds, ips, fps, ns, r->peak_kb);
+	}
+	else
+	{
+		printf("%s,%s,%lu,%llu,%.6f,%.0f,%.1f,%.3f,%ld\n", name, engine_names[engine],
+			r->frames, r->instructions, r->seconds, ips, fps, ns, r->peak_kb);
+	}
+}
+
+int main(int argv, char *argc[])
+{
+	unsigned long frames = BENCH_FRAMES;
+	unsigned int ipf = BENCH_IPF;
+	u32 seed = BENCH_SEED;
+	char *input_name = NULL;
+	int engine = -1;
+	int lanes = BENCH_LANES;
+	u8 json = 0, first = 1, has_seed = 0, e, failed = 0;
+	int arg, roms = 0;
+	struct stat st;
+	Result r;
+	
+	for (arg = 1; arg < argv; arg++)
+	{
+		if (strcmp(argc[arg], "-frames") == 0 && arg + 1 < argv)
+		{
+			frames = strtoul(argc[++arg], NULL, 10);
+		}
+		else if (strcmp(argc[arg], "-ipf") == 0 && arg + 1 < argv)
+		{
+			ipf = strtoul(argc[++arg], NULL, 10);
+		}
+		else if (strcmp(argc[arg], "-seed") == 0 && arg + 1 < argv)
+		{
+			seed = strtoul(argc[++arg], NULL, 0);
+			has_seed = 1;
+		}
+		else if ((strcmp(argc[arg], "-input") == 0 || strcmp(argc[arg], "-s") == 0) && arg + 1 < argv)
+		{
+			input_name = argc[++arg];
+		}
+		else if (strcmp(argc[arg], "-engine") == 0 && arg + 1 < argv)
+		{
+			arg++;
+			for (engine = BENCH_BATCH; engine >= 0 && strcmp(argc[arg], engine_names[engine]) != 0; engine--)
+			{
+			}
+			if (engine < 0 && strcmp(argc[arg], "all") != 0)
+			{
+				usage(argc[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argc[arg], "-lanes") == 0 && arg + 1 < argv)
+		{
+			lanes = strtoul(argc[++arg], NULL, 10);
+			if (lanes < 1)
+			{
+				usage(argc[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argc[arg], "-json") == 0)
+		{
+			json = 1;
+		}
+		else if (argc[arg][0] == '-')
+		{
+			usage(argc[0]);
+			return 1;
+		}
+		else
+		{
+			roms++;
+		}
+	}
+	if (roms == 0)
+	{
+		usage(argc[0]);
+		return 1;
+	}
+	
+	// Batch lane l plays frame f with the keys of frame f + 7 l
+	if (input_name != NULL && !bench_script(input_name, frames + 7 * lanes, &seed, has_seed))
+	{
+		fprintf(stderr, "Error, can not read %s.\n", input_name);
+		return 1;
+	}
+	
+	if (json)
+	{
+		printf("[");
+	}
+	else
+	{
+		printf("rom,engine,frames,instructions,seconds,instructions_per_second,frames_per_second,ns_per_instruction,peak_rss_kb\n");
+	}
+	for (arg = 1; arg < argv; arg++)
+	{
+		if (argc[arg][0] == '-')
+		{
+			// Options with a value were checked above
+			if (strcmp(argc[arg], "-json") != 0)
+			{
+				arg++;
+			}
+			continue;
+		}
+		
+		// Can not be a ROM
+		if (stat(argc[arg], &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || st.st_size > ROM_MAX)
+		{
+			fprintf(stderr, "Skipping %s\n", argc[arg]);
+			continue;
+		}
+		for (e = 0; e <= BENCH_BATCH; e++)
+		{
+			if (engine >= 0 && e != engine)
+			{
+				continue;
+			}
+			if (engine < 0 && e == ENGINE_AOT && aot_programs[0].run == NULL)
+			{
+				// Only the threaded engine under another name, make aot compiles the ROMs in
+				continue;
+			}
+			if (!bench_fork(argc[arg], e, lanes, frames, ipf, seed, &r))
+			{
+				fprintf(stderr, "Failed %s with %s\n", argc[arg], engine_names[e]);
+				failed = 1;
+				continue;
+			}
+			print_result(argc[arg], e, &r, json, first);
+			first = 0;
+		}
+	}
+	if (json)
+	{
+		printf("\n]\n");
+	}
+	return failed;
+}
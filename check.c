@@ -0,0 +1,453 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+/*
+
+Differential check
+
+Runs every ROM given on every engine side by side, the same keys and the
+same seed for all of them, and compares each machine with the one run by
+the switch engine, the reference, after every frame. The first thing that
+differs is told with the frame it was found at, and the check fails.
+
+The batch engine is checked the same way: each of its lanes against a
+machine of its own on the switch engine, lane l playing the keys of frame
+f + 7 l with seed + l, so the lanes go apart as in the benchmark.
+
+Forks are checked on every engine too. Halfway through, a fork is taken of
+the running machine and put back CHECK_FORKS times, in turn in the same
+machine and in another one that played other keys. Try t plays the keys of
+frame f + 7 t from there, and after every frame is compared with a machine
+replayed from the start on the switch engine with the same keys.
+
+	make check
+	./chip8-check -frames 600 -input keys.txt -quirks vip roms/PONG
+
+Keys come from an input script, as -input of chip8, or by default from a
+fixed pattern, every key in turn, so two runs do exactly the same.
+
+*/
+
+#include "machine.h"
+#include "script.h"
+#include "batch.h"
+#include "fork.h"
+
+// Defaults, under a minute of game time but fast enough to run every change
+
+#define CHECK_FRAMES 3000
+#define CHECK_IPF 200
+#define CHECK_SEED 1
+#define CHECK_LANES 8
+#define CHECK_FORKS 4
+
+// Engines compared, ENGINE_SWITCH first
+
+#define CHECK_ENGINES (ENGINE_AOT + 1)
+
+static const char *engine_names[] = { "switch", "cache", "threaded", "jit", "aot" };
+
+void usage(char *name)
+{
+	printf("Usage: %s [options] rom...\n", name);
+	printf("  -frames n      frames for every ROM, %d by default\n", CHECK_FRAMES);
+	printf("  -ipf n         instructions per frame, %d by default\n", CHECK_IPF);
+	printf("  -seed n        seed for random numbers, %d by default\n", CHECK_SEED);
+	printf("  -input file    keys from a script instead of the fixed pattern\n");
+	printf("  -quirks list   quirks instead of the ROM's, as for chip8\n");
+	printf("  -lanes n       machines run together by batch, %d by default, 0 for none\n", CHECK_LANES);
+}
+
+u16 *check_keys(char *input_name, unsigned long frames, u32 *seed, u8 has_seed)
+{
+	// Keys of every frame, read once so each engine gets the same ones, and the seed of the script unless one was given
+	
+	Script script;
+	unsigned long f;
+	u16 *keys = malloc((frames + 1) * sizeof(u16));
+	
+	if (keys == NULL)
+	{
+		return NULL;
+	}
+	if (input_name == NULL)
+	{
+		// Every key in turn, down for 20 frames and up for 10
+		for (f = 0; f <= frames; f++)
+		{
+			keys[f] = (f % 30 >= 20) ? 0 : 1 << ((f / 30 * 5) % 16);
+		}
+		return keys;
+	}
+	if (!script_open(&script, input_name))
+	{
+		free(keys);
+		return NULL;
+	}
+	if (!has_seed && script.has_seed)
+	{
+		*seed = script.seed;
+	}
+	for (f = 0; f <= frames; f++)
+	{
+		keys[f] = script_keys(&script, f);
+	}
+	script_close(&script);
+	return keys;
+}
+
+const char *check_differs(Machine *a, Machine *b)
+{
+	// Name of the first part of b that is not as in a, NULL when none
+	
+	if (a->PC != b->PC)
+	{
+		return "PC";
+	}
+	if (a->IR != b->IR)
+	{
+		return "IR";
+	}
+	if (memcmp(a->V, b->V, sizeof(a->V)) != 0)
+	{
+		return "V";
+	}
+	if (a->I != b->I)
+	{
+		return "I";
+	}
+	if (a->SP != b->SP || memcmp(a->stack, b->stack, sizeof(a->stack)) != 0)
+	{
+		return "stack";
+	}
+	if (a->DT != b->DT || a->ST != b->ST)
+	{
+		return "timers";
+	}
+	if (a->frame != b->frame || a->waiting != b->waiting)
+	{
+		return "frame";
+	}
+	if (a->rng != b->rng)
+	{
+		return "rng";
+	}
+	if (memcmp(a->memory, b->memory, sizeof(a->memory)) != 0)
+	{
+		return "memory";
+	}
+	if (a->hires != b->hires || memcmp(a->Display, b->Display, sizeof(a->Display)) != 0)
+	{
+		return "Display";
+	}
+	if (memcmp(a->flags, b->flags, sizeof(a->flags)) != 0)
+	{
+		return "flags";
+	}
+	return NULL;
+}
+
+int check_load(Machine *m, char *rom, u8 engine, unsigned int ipf, u32 seed, u8 quirks, u8 quirks_given)
+{
+	// A new machine with the game, 1 when it loaded
+	
+	machine_init(m);
+	machine_seed(m, seed);
+	m->engine = engine;
+	m->ipf = ipf;
+	if (read_rom(m) != LOAD_OK || read_game(m, rom) != LOAD_OK)
+	{
+		return 0;
+	}
+	if (quirks_given)
+	{
+		m->quirks = quirks;
+		machine_flush(m);
+	}
+	return 1;
+}
+
+int check_rom(char *rom, u16 *keys, unsigned long frames, unsigned int ipf, u32 seed, u8 quirks, u8 quirks_given)
+{
+	// 1 when every engine did as the switch one all the way
+	
+	Machine *m = malloc(CHECK_ENGINES * sizeof(Machine));
+	const char *part = NULL;
+	unsigned long f;
+	int e, ok = 1;
+	
+	if (m == NULL)
+	{
+		return 0;
+	}
+	for (e = 0; e < CHECK_ENGINES; e++)
+	{
+		if (!check_load(&m[e], rom, e, ipf, seed, quirks, quirks_given) && ok)
+		{
+			printf("%s: can not be loaded\n", rom);
+			ok = 0;
+		}
+	}
+	
+	for (f = 0; f < frames && ok; f++)
+	{
+		for (e = 0; e < CHECK_ENGINES; e++)
+		{
+			m[e].keys = keys[f];
+			machine_run(&m[e]);
+		}
+		for (e = 1; e < CHECK_ENGINES && ok; e++)
+		{
+			part = check_differs(&m[0], &m[e]);
+			if (part != NULL)
+			{
+				printf("%s: %s differs from switch in %s at frame %lu, PC %03X and %03X\n",
+					rom, engine_names[e], part, f, m[0].PC, m[e].PC);
+				ok = 0;
+			}
+		}
+	}
+	for (e = 0; e < CHECK_ENGINES; e++)
+	{
+		machine_free(&m[e]);
+	}
+	free(m);
+	return ok;
+}
+
+int check_batch(char *rom, int lanes, u16 *keys, unsigned long frames, unsigned int ipf, u32 seed, u8 quirks, u8 quirks_given)
+{
+	// 1 when every lane did as a machine run alone all the way
+	
+	Machine *m = malloc(lanes * sizeof(Machine));
+	const char *part = NULL;
+	unsigned long f;
+	int l, ok = 1;
+	Batch b;
+	
+	if (m == NULL || !batch_init(&b, lanes, rom))
+	{
+		printf("%s: can not be loaded in a batch\n", rom);
+		free(m);
+		return 0;
+	}
+	b.ipf = ipf;
+	for (l = 0; l < lanes; l++)
+	{
+		machine_init(&m[l]);
+		machine_seed(&m[l], seed + l);
+		m[l].ipf = ipf;
+		read_rom(&m[l]);
+		read_game(&m[l], rom);
+		machine_seed(&b.lane[l], seed + l);
+		if (quirks_given)
+		{
+			m[l].quirks = quirks;
+			b.lane[l].quirks = quirks;
+		}
+	}
+	
+	for (f = 0; f < frames && ok; f++)
+	{
+		for (l = 0; l < lanes; l++)
+		{
+			m[l].keys = keys[f + 7 * l];
+			b.lane[l].keys = keys[f + 7 * l];
+			machine_run(&m[l]);
+		}
+		batch_run(&b);
+		for (l = 0; l < lanes && ok; l++)
+		{
+			part = check_differs(&m[l], batch_sync(&b, l));
+			if (part != NULL)
+			{
+				printf("%s: batch lane %d differs from switch in %s at frame %lu, PC %03X and %03X\n",
+					rom, l, part, f, m[l].PC, b.PC[l]);
+				ok = 0;
+			}
+		}
+	}
+	
+	for (l = 0; l < lanes; l++)
+	{
+		machine_free(&m[l]);
+	}
+	free(m);
+	batch_free(&b);
+	return ok;
+}
+
+int check_fork(char *rom, u16 *keys, unsigned long frames, unsigned int ipf, u32 seed, u8 quirks, u8 quirks_given)
+{
+	// 1 when every machine put back from a fork did as one replayed from the start
+	
+	Machine *m = malloc(3 * sizeof(Machine));
+	Machine *to, *ref;
+	Fork *root;
+	const char *part = NULL;
+	unsigned long f, half = frames / 2;
+	int e, t, ok = 1;
+	
+	if (m == NULL)
+	{
+		return 0;
+	}
+	ref = &m[2];
+	for (e = 0; e < CHECK_ENGINES && ok; e++)
+	{
+		// Forked halfway, and another machine gone elsewhere to put it back in
+		check_load(&m[0], rom, e, ipf, seed, quirks, quirks_given);
+		check_load(&m[1], rom, e, ipf, seed + 1, quirks, quirks_given);
+		for (f = 0; f < half; f++)
+		{
+			m[0].keys = keys[f];
+			m[1].keys = keys[f + 7 * CHECK_FORKS];
+			machine_run(&m[0]);
+			machine_run(&m[1]);
+		}
+		root = fork_take(&m[0]);
+		if (root == NULL)
+		{
+			printf("%s: out of memory for a fork\n", rom);
+			ok = 0;
+		}
+		
+		for (t = 0; t < CHECK_FORKS && ok; t++)
+		{
+			to = &m[t & 1];
+			fork_restore(to, root);
+			check_load(ref, rom, ENGINE_SWITCH, ipf, seed, quirks, quirks_given);
+			for (f = 0; f < frames && ok; f++)
+			{
+				ref->keys = keys[f < half ? f : f + 7 * t];
+				machine_run(ref);
+				if (f + 1 < half)
+				{
+					continue;
+				}
+				if (f + 1 > half)
+				{
+					to->keys = ref->keys;
+					machine_run(to);
+				}
+				part = check_differs(ref, to);
+				if (part != NULL)
+				{
+					printf("%s: %s put back from a fork, try %d, differs from switch in %s at frame %lu, PC %03X and %03X\n",
+						rom, engine_names[e], t, part, f, ref->PC, to->PC);
+					ok = 0;
+				}
+			}
+			machine_free(ref);
+		}
+		fork_free(root);
+		machine_free(&m[0]);
+		machine_free(&m[1]);
+	}
+	free(m);
+	return ok;
+}
+
+int main(int argv, char *argc[])
+{
+	unsigned long frames = CHECK_FRAMES;
+	unsigned int ipf = CHECK_IPF;
+	u32 seed = CHECK_SEED;
+	char *input_name = NULL;
+	u8 quirks = 0, quirks_given = 0, has_seed = 0, failed = 0;
+	int arg, roms = 0;
+	int lanes = CHECK_LANES;
+	u16 *keys;
+	
+	for (arg = 1; arg < argv; arg++)
+	{
+		if (strcmp(argc[arg], "-frames") == 0 && arg + 1 < argv)
+		{
+			frames = strtoul(argc[++arg], NULL, 10);
+		}
+		else if (strcmp(argc[arg], "-ipf") == 0 && arg + 1 < argv)
+		{
+			ipf = strtoul(argc[++arg], NULL, 10);
+		}
+		else if (strcmp(argc[arg], "-seed") == 0 && arg + 1 < argv)
+		{
+			seed = strtoul(argc[++arg], NULL, 0);
+			has_seed = 1;
+		}
+		else if (strcmp(argc[arg], "-input") == 0 && arg + 1 < argv)
+		{
+			input_name = argc[++arg];
+		}
+		else if (strcmp(argc[arg], "-quirks") == 0 && arg + 1 < argv)
+		{
+			if (!quirks_parse(argc[++arg], &quirks))
+			{
+				usage(argc[0]);
+				return 1;
+			}
+			quirks_given = 1;
+		}
+		else if (strcmp(argc[arg], "-lanes") == 0 && arg + 1 < argv)
+		{
+			lanes = strtol(argc[++arg], NULL, 10);
+			if (lanes < 0)
+			{
+				usage(argc[0]);
+				return 1;
+			}
+		}
+		else if (argc[arg][0] == '-')
+		{
+			usage(argc[0]);
+			return 1;
+		}
+		else
+		{
+			roms++;
+		}
+	}
+	if (roms == 0)
+	{
+		usage(argc[0]);
+		return 1;
+	}
+	
+	keys = check_keys(input_name, frames + 7 * (lanes > CHECK_FORKS ? lanes : CHECK_FORKS), &seed, has_seed);
+	if (keys == NULL)
+	{
+		printf("Error, can not read %s.\n", input_name);
+		return 1;
+	}
+	for (arg = 1; arg < argv; arg++)
+	{
+		if (argc[arg][0] == '-')
+		{
+			// Every option has a value
+			arg++;
+			continue;
+		}
+		if (!check_rom(argc[arg], keys, frames, ipf, seed, quirks, quirks_given)
+			|| !check_fork(argc[arg], keys, frames, ipf, seed, quirks, quirks_given)
+			|| (lanes > 0 && !check_batch(argc[arg], lanes, keys, frames, ipf, seed, quirks, quirks_given)))
+		{
+			failed = 1;
+		}
+		else
+		{
+			printf("%s: ok\n", argc[arg]);
+		}
+	}
+	free(keys);
+	return failed;
+}
@@ -0,0 +1,181 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "disasm.h"
+#include "ops.h"
+
+// Name of every OP_*, in the order of the enum
+
+static const char *op_names[OP_COUNT] =
+{
+	"(decode)", "CLS", "RET", "SYS", "JP", "CALL", "SE Vx, kk", "SNE Vx, kk",
+	"SE Vx, Vy", "LD Vx, kk", "ADD Vx, kk", "LD Vx, Vy", "OR", "AND", "XOR",
+	"ADD Vx, Vy", "SUB", "SHR", "SUBN", "SHL", "SNE Vx, Vy", "LD I, nnn",
+	"JP V0, nnn", "RND", "DRW", "SKP", "SKNP", "LD Vx, DT", "LD Vx, K",
+	"LD DT, Vx", "LD ST, Vx", "ADD I, Vx", "LD F, Vx", "LD B, Vx",
+	"LD [I], Vx", "LD Vx, [I]", "SCD", "SCR", "SCL", "EXIT", "LOW", "HIGH",
+	"LD HF, Vx", "LD R, Vx", "LD Vx, R", "(none)"
+};
+
+const char *disasm_op (u8 op)
+{
+	return op < OP_COUNT ? op_names[op] : "?";
+}
+
+void disasm (u16 ir, char *text)
+{
+	Instr in;
+	
+	// Same decoder as the machine, so it reads it the same way
+	instr_decode(&in, ir);
+	
+	switch (in.op)
+	{
+		case OP_CLS:
+			sprintf(text, "CLS");
+			break;
+		case OP_RET:
+			sprintf(text, "RET");
+			break;
+		case OP_SYS:
+			sprintf(text, "SYS 0x%03X", in.nnn);
+			break;
+		case OP_JP:
+			sprintf(text, "JP 0x%03X", in.nnn);
+			break;
+		case OP_CALL:
+			sprintf(text, "CALL 0x%03X", in.nnn);
+			break;
+		case OP_SE_BYTE:
+			sprintf(text, "SE V%X, 0x%02X", in.x, in.kk);
+			break;
+		case OP_SNE_BYTE:
+			sprintf(text, "SNE V%X, 0x%02X", in.x, in.kk);
+			break;
+		case OP_SE_REG:
+			sprintf(text, "SE V%X, V%X", in.x, in.y);
+			break;
+		case OP_LD_BYTE:
+			sprintf(text, "LD V%X, 0x%02X", in.x, in.kk);
+			break;
+		case OP_ADD_BYTE:
+			sprintf(text, "ADD V%X, 0x%02X", in.x, in.kk);
+			break;
+		case OP_LD_REG:
+			sprintf(text, "LD V%X, V%X", in.x, in.y);
+			break;
+		case OP_OR:
+			sprintf(text, "OR V%X, V%X", in.x, in.y);
+			break;
+		case OP_AND:
+			sprintf(text, "AND V%X, V%X", in.x, in.y);
+			break;
+		case OP_XOR:
+			sprintf(text, "XOR V%X, V%X", in.x, in.y);
+			break;
+		case OP_ADD_REG:
+			sprintf(text, "ADD V%X, V%X", in.x, in.y);
+			break;
+		case OP_SUB:
+			sprintf(text, "SUB V%X, V%X", in.x, in.y);
+			break;
+		case OP_SHR:
+			sprintf(text, "SHR V%X {, V%X}", in.x, in.y);
+			break;
+		case OP_SUBN:
+			sprintf(text, "SUBN V%X, V%X", in.x, in.y);
+			break;
+		case OP_SHL:
+			sprintf(text, "SHL V%X {, V%X}", in.x, in.y);
+			break;
+		case OP_SNE_REG:
+			sprintf(text, "SNE V%X, V%X", in.x, in.y);
+			break;
+		case OP_LD_I:
+			sprintf(text, "LD I, 0x%03X", in.nnn);
+			break;
+		case OP_JP_V0:
+			sprintf(text, "JP V0, 0x%03X", in.nnn);
+			break;
+		case OP_RND:
+			sprintf(text, "RND V%X, 0x%02X", in.x, in.kk);
+			break;
+		case OP_DRW:
+			sprintf(text, "DRW V%X, V%X, 0x%X", in.x, in.y, in.n);
+			break;
+		case OP_SKP:
+			sprintf(text, "SKP V%X", in.x);
+			break;
+		case OP_SKNP:
+			sprintf(text, "SKNP V%X", in.x);
+			break;
+		case OP_LD_VX_DT:
+			sprintf(text, "LD V%X, DT", in.x);
+			break;
+		case OP_LD_KEY:
+			sprintf(text, "LD V%X, K", in.x);
+			break;
+		case OP_LD_DT:
+			sprintf(text, "LD DT, V%X", in.x);
+			break;
+		case OP_LD_ST:
+			sprintf(text, "LD ST, V%X", in.x);
+			break;
+		case OP_ADD_I:
+			sprintf(text, "ADD I, V%X", in.x);
+			break;
+		case OP_LD_F:
+			sprintf(text, "LD F, V%X", in.x);
+			break;
+		case OP_LD_B:
+			sprintf(text, "LD B, V%X", in.x);
+			break;
+		case OP_LD_MEM:
+			sprintf(text, "LD [I], V%X", in.x);
+			break;
+		case OP_LD_REG_MEM:
+			sprintf(text, "LD V%X, [I]", in.x);
+			break;
+		case OP_SCD:
+			sprintf(text, "SCD 0x%X", in.n);
+			break;
+		case OP_SCR:
+			sprintf(text, "SCR");
+			break;
+		case OP_SCL:
+			sprintf(text, "SCL");
+			break;
+		case OP_EXIT:
+			sprintf(text, "EXIT");
+			break;
+		case OP_LOW:
+			sprintf(text, "LOW");
+			break;
+		case OP_HIGH:
+			sprintf(text, "HIGH");
+			break;
+		case OP_LD_HF:
+			sprintf(text, "LD HF, V%X", in.x);
+			break;
+		case OP_LD_R:
+			sprintf(text, "LD R, V%X", in.x);
+			break;
+		case OP_LD_VX_R:
+			sprintf(text, "LD V%X, R", in.x);
+			break;
+		default:
+			sprintf(text, "DW 0x%04X", ir);
+			break;
+	}
+}
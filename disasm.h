@@ -0,0 +1,23 @@
+#ifndef _DISASM_H
+#define _DISASM_H
+
+#include "machine.h"
+
+/*
+
+Disassembler
+
+Turns an opcode into the text of the instruction, written the way the
+Cowgod reference writes it: "DRW V0, V1, 0x5". Opcodes that are not an
+instruction come out as data words, "DW 0x1234".
+
+*/
+
+// Longest text disasm writes, with the 0
+
+#define DISASM_MAX 24
+
+const char *disasm_op (u8 op);
+void disasm (u16 ir, char *text);
+
+#endif
@@ -0,0 +1,178 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "fork.h"
+#include "ops.h"
+
+static void page_hold (Page *p)
+{
+	__atomic_add_fetch(&p->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void page_drop (Page *p)
+{
+	// The last one out frees it
+	
+	if (p != NULL && __atomic_sub_fetch(&p->refs, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		free(p);
+	}
+}
+
+Fork *fork_take (Machine *m)
+{
+	// NULL when out of memory
+	
+	Fork *f;
+	Page *p;
+	int i;
+	
+	f = malloc(sizeof(Fork));
+	if (f == NULL)
+	{
+		return NULL;
+	}
+	for (i = 0; i < FORK_PAGES; i++)
+	{
+		if (m->page[i] == NULL || (m->written >> i & 1))
+		{
+			// Changed since it was shared, from now on the machine has a copy of its own
+			p = malloc(sizeof(Page));
+			if (p == NULL)
+			{
+				while (--i >= 0)
+				{
+					page_drop(f->page[i]);
+				}
+				free(f);
+				return NULL;
+			}
+			p->refs = 1;
+			memcpy(p->bytes, &m->memory[i * FORK_PAGE], FORK_PAGE);
+			page_drop(m->page[i]);
+			m->page[i] = p;
+			m->written &= ~(1 << i);
+		}
+		page_hold(m->page[i]);
+		f->page[i] = m->page[i];
+	}
+	f->rom = m->rom;
+	f->quirks = m->quirks;
+	f->ipf = m->ipf;
+	memcpy(f->V, m->V, sizeof(f->V));
+	f->I = m->I;
+	f->IR = m->IR;
+	f->PC = m->PC;
+	memcpy(f->stack, m->stack, sizeof(f->stack));
+	f->SP = m->SP;
+	f->DT = m->DT;
+	f->ST = m->ST;
+	f->frame = m->frame;
+	f->keys = m->keys;
+	f->waiting = m->waiting;
+	f->rng = m->rng;
+	memcpy(f->Display, m->Display, sizeof(f->Display));
+	f->hires = m->hires;
+	memcpy(f->flags, m->flags, sizeof(f->flags));
+	return f;
+}
+
+void fork_restore (Machine *m, const Fork *f)
+{
+	// Only pages that are not the fork's are looked at, and only bytes that differ go through mem_write
+	
+	const u8 *bytes;
+	u16 i, b, base;
+	int p;
+	
+	if (m->quirks != f->quirks)
+	{
+		// Code decoded for other quirks is of no use
+		m->quirks = f->quirks;
+		machine_flush(m);
+	}
+	for (p = 0; p < FORK_PAGES; p++)
+	{
+		if (m->page[p] == f->page[p] && !(m->written >> p & 1))
+		{
+			continue;
+		}
+		bytes = f->page[p]->bytes;
+		base = p * FORK_PAGE;
+		for (i = 0; i < FORK_PAGE; i += 8)
+		{
+			if (memcmp(&m->memory[base + i], &bytes[i], 8) != 0)
+			{
+				for (b = i; b < i + 8; b++)
+				{
+					if (m->memory[base + b] != bytes[b])
+					{
+						mem_write(m, base + b, bytes[b]);
+					}
+				}
+			}
+		}
+		page_hold(f->page[p]);
+		page_drop(m->page[p]);
+		m->page[p] = f->page[p];
+	}
+	m->written = 0;
+	m->rom = f->rom;
+	m->ipf = f->ipf;
+	memcpy(m->V, f->V, sizeof(m->V));
+	m->I = f->I;
+	m->IR = f->IR;
+	m->PC = f->PC;
+	memcpy(m->stack, f->stack, sizeof(m->stack));
+	m->SP = f->SP;
+	m->DT = f->DT;
+	m->ST = f->ST;
+	m->frame = f->frame;
+	m->keys = f->keys;
+	m->waiting = f->waiting;
+	m->rng = f->rng;
+	memcpy(m->Display, f->Display, sizeof(m->Display));
+	m->hires = f->hires;
+	memcpy(m->flags, f->flags, sizeof(m->flags));
+	m->dirty = ALL_LINES(m);
+}
+
+void fork_free (Fork *f)
+{
+	int i;
+	
+	if (f == NULL)
+	{
+		return;
+	}
+	for (i = 0; i < FORK_PAGES; i++)
+	{
+		page_drop(f->page[i]);
+	}
+	free(f);
+}
+
+void fork_release (Machine *m)
+{
+	// Let go of the pages shared with forks, memory stays as it is
+	
+	int i;
+	
+	for (i = 0; i < FORK_PAGES; i++)
+	{
+		page_drop(m->page[i]);
+		m->page[i] = NULL;
+	}
+	m->written = 0xFFFF;
+}
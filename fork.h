@@ -0,0 +1,81 @@
+#ifndef _FORK_H
+#define _FORK_H
+
+#include "machine.h"
+
+/*
+
+Machine forks
+
+A Fork is a machine frozen at some point, to be put back in the same or in
+another machine as many times as wanted, for example to try different keys
+from the same position in a tree search. Memory is kept in pages of
+FORK_PAGE bytes shared by reference between the machine and every fork
+taken from it. A page is only copied when the machine wrote to it since the
+last fork, so the fonts, the program and whatever did not change cost
+nothing: a fork is its registers, the screen and the pages written.
+
+The machine keeps in page[] the pages its memory last matched and in
+written the ones it changed since, mem_write sets the bit. Putting a fork
+back only touches the bytes that differ from it, so what was decoded or
+translated for the rest of memory is kept.
+
+A Fork is not a machine and can not run on its own: it has no engine, no
+decoded or translated code, no trace, only the state to put back. To run
+from it, restore it into a full Machine, one set up with machine_init and
+loaded (read_rom, read_game), which can be another than the one it was
+taken from. make check does so on every engine and compares each run with
+one replayed from the start.
+
+Pages are counted with atomic operations, forks can be taken on one thread
+and put back in machines on other threads. A machine is still only used by
+one thread at a time.
+
+	Fork *root = fork_take(m);
+	for (i = 0; i < 4; i++)
+	{
+		fork_restore(m, root);
+		... play some frames with keys i
+	}
+	fork_free(root);
+
+*/
+
+#define FORK_PAGE 256
+#define FORK_PAGES (4096 / FORK_PAGE)
+
+struct Page
+{
+	int refs;
+	u8 bytes[FORK_PAGE];
+};
+
+typedef struct Fork
+{
+	Page *page[FORK_PAGES];
+	unsigned long rom;
+	u8 quirks;
+	unsigned int ipf;
+	u8 V[16];
+	u16 I;
+	u16 IR;
+	u16 PC;
+	u16 stack[16];
+	u8 SP;
+	u16 DT;
+	u16 ST;
+	unsigned long frame;
+	u16 keys;
+	u8 waiting;
+	u32 rng;
+	u64 Display[Y_HIRES][2];
+	u8 hires;
+	u8 flags[16];
+} Fork;
+
+Fork *fork_take (Machine *m);
+void fork_restore (Machine *m, const Fork *f);
+void fork_free (Fork *f);
+void fork_release (Machine *m);
+
+#endif
@@ -0,0 +1,1007 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+
+#include "ops.h"
+
+/*
+
+Dynamic recompiler
+
+Straight runs of instructions (basic blocks) are translated once to x86-64
+code and then called like a function. Inside a block the V registers live
+in host registers and only go back to memory before a helper call and when
+the block leaves. Simple instructions are written out directly, the rest
+(drawing, random numbers, keyboard, BCD, register dumps) call the same
+functions of ops.h the interpreter uses.
+
+A block ends at the first jump, call, return or skip, after an instruction
+that writes memory (the block itself could be the one overwritten), or when
+it is JIT_BLOCK_MAX long. mem_write tells us about every store so blocks
+over the written byte are thrown away. The code itself is never rewritten,
+so the buffer is executable and not writable except for the pages of the
+block being compiled, while it is.
+
+A block always runs whole, so it is only entered when the instructions left
+until the timers tick are enough; otherwise the interpreter goes one step,
+which keeps the timing exactly the one of the switch engine. The switch
+engine is also the reference to compare against.
+
+*/
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define JIT_CODE_SIZE (1024 * 1024)
+#define JIT_BLOCK_MAX 16
+#define JIT_BLOCKS 8192
+
+// Room a block may need, a full buffer is thrown away before compiling
+
+#define JIT_BLOCK_SIZE 4096
+#define JIT_PROLOGUE_MAX 20
+
+// Host registers, numbered as the encoding does
+
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RBP 5
+#define RSI 6
+#define RDI 7
+
+// Condition codes for setcc and cmovcc
+
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_A 0x7
+
+// Offsets of the machine fields, rbx holds the machine during a block
+
+#define OFF_V(x) ((int) (offsetof(Machine, V) + (x)))
+#define OFF_I ((int) offsetof(Machine, I))
+#define OFF_IR ((int) offsetof(Machine, IR))
+#define OFF_PC ((int) offsetof(Machine, PC))
+#define OFF_SP ((int) offsetof(Machine, SP))
+#define OFF_STACK ((int) offsetof(Machine, stack))
+#define OFF_DT ((int) offsetof(Machine, DT))
+#define OFF_ST ((int) offsetof(Machine, ST))
+
+typedef struct Block Block;
+
+struct Block
+{
+	void (*code) (Machine *m);
+	u16 start;
+	u16 end;
+	u8 count;
+
+	// Starts with Fx07, maybe a delay timer loop
+	u8 idle;
+};
+
+struct Jit
+{
+	// Executable memory and how much of it is used, only made writable by jit_compile
+	u8 *code;
+	u8 *p;
+
+	// Block starting at every address
+	Block *map[4096];
+	Block blocks[JIT_BLOCKS];
+	int nblocks;
+
+	// How many blocks cover every byte, and the addresses that can not start one
+	u8 covered[4096];
+	u8 refused[4096];
+
+	// Operands for the helpers, decoded at compile time
+	Instr instrs[4096];
+
+	// Where every V register is while compiling, -1 when in memory
+	signed char host[16];
+	u8 dirty[16];
+	unsigned int used[16];
+	unsigned int stamp;
+
+	// Host registers the block touched that have to be saved for the caller
+	u8 save[16];
+
+	// Quirks of the machine, the code is made for them alone
+	u8 quirks;
+};
+
+// V registers are given out from these, none of them is needed for anything else
+
+static const u8 pool[] = {RSI, RDI, 8, 9, 10, 11, 12, 13, 14, 15, RBP};
+
+#define POOL_SIZE ((int) sizeof(pool))
+
+static void emit8 (Jit *j, u8 b)
+{
+	*j->p++ = b;
+}
+
+static void emit16 (Jit *j, u16 w)
+{
+	emit8(j, w & 0xFF);
+	emit8(j, w >> 8);
+}
+
+static void emit32 (Jit *j, unsigned int d)
+{
+	emit16(j, d & 0xFFFF);
+	emit16(j, d >> 16);
+}
+
+static void emit64 (Jit *j, unsigned long long q)
+{
+	emit32(j, q & 0xFFFFFFFF);
+	emit32(j, q >> 32);
+}
+
+// REX prefix, force is for the byte registers of rsi, rdi and rbp
+
+static void emit_rex (Jit *j, int reg, int rm, int force)
+{
+	u8 rex = 0x40 | ((reg >> 3) & 1) << 2 | ((rm >> 3) & 1);
+	
+	if (rex != 0x40 || force)
+	{
+		emit8(j, rex);
+	}
+}
+
+static void emit_modrm (Jit *j, int reg, int rm)
+{
+	emit8(j, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// [rbx + disp32]
+
+static void emit_mem (Jit *j, int reg, int disp)
+{
+	emit8(j, 0x80 | (reg & 7) << 3 | RBX);
+	emit32(j, disp);
+}
+
+// mov dst, src
+
+static void emit_mov (Jit *j, int dst, int src)
+{
+	emit_rex(j, src, dst, 0);
+	emit8(j, 0x89);
+	emit_modrm(j, src, dst);
+}
+
+// mov dst, imm32
+
+static void emit_mov_imm (Jit *j, int dst, unsigned int imm)
+{
+	emit_rex(j, 0, dst, 0);
+	emit8(j, 0xB8 + (dst & 7));
+	emit32(j, imm);
+}
+
+// add/or/and/sub/xor/cmp dst, src
+
+static void emit_alu (Jit *j, u8 opcode, int dst, int src)
+{
+	emit_rex(j, src, dst, 0);
+	emit8(j, opcode);
+	emit_modrm(j, src, dst);
+}
+
+#define ALU_ADD 0x01
+#define ALU_OR 0x09
+#define ALU_AND 0x21
+#define ALU_SUB 0x29
+#define ALU_XOR 0x31
+#define ALU_CMP 0x39
+
+// add/and/cmp dst, imm32, ext is the opcode extension
+
+static void emit_alu_imm (Jit *j, int ext, int dst, unsigned int imm)
+{
+	emit_rex(j, 0, dst, 0);
+	emit8(j, 0x81);
+	emit_modrm(j, ext, dst);
+	emit32(j, imm);
+}
+
+#define IMM_ADD 0
+#define IMM_AND 4
+#define IMM_CMP 7
+
+// shl/shr dst, n
+
+static void emit_shift (Jit *j, int ext, int dst, u8 n)
+{
+	emit_rex(j, 0, dst, 0);
+	emit8(j, 0xC1);
+	emit_modrm(j, ext, dst);
+	emit8(j, n);
+}
+
+#define SHIFT_SHL 4
+#define SHIFT_SHR 5
+
+// setcc cl
+
+static void emit_setcc (Jit *j, int cc)
+{
+	emit8(j, 0x0F);
+	emit8(j, 0x90 | cc);
+	emit_modrm(j, 0, RCX);
+}
+
+// cmovcc dst, src
+
+static void emit_cmov (Jit *j, int cc, int dst, int src)
+{
+	emit_rex(j, dst, src, 0);
+	emit8(j, 0x0F);
+	emit8(j, 0x40 | cc);
+	emit_modrm(j, dst, src);
+}
+
+// movzx dst, byte [rbx + disp]
+
+static void emit_load8 (Jit *j, int dst, int disp)
+{
+	emit_rex(j, dst, RBX, 0);
+	emit8(j, 0x0F);
+	emit8(j, 0xB6);
+	emit_mem(j, dst, disp);
+}
+
+// mov byte [rbx + disp], src
+
+static void emit_store8 (Jit *j, int src, int disp)
+{
+	emit_rex(j, src, RBX, 1);
+	emit8(j, 0x88);
+	emit_mem(j, src, disp);
+}
+
+// mov word [rbx + disp], src
+
+static void emit_store16 (Jit *j, int src, int disp)
+{
+	emit8(j, 0x66);
+	emit_rex(j, src, RBX, 0);
+	emit8(j, 0x89);
+	emit_mem(j, src, disp);
+}
+
+// mov word [rbx + disp], imm16
+
+static void emit_store16_imm (Jit *j, int disp, u16 imm)
+{
+	emit8(j, 0x66);
+	emit8(j, 0xC7);
+	emit_mem(j, 0, disp);
+	emit16(j, imm);
+}
+
+// add word [rbx + disp], src
+
+static void emit_add16 (Jit *j, int src, int disp)
+{
+	emit8(j, 0x66);
+	emit_rex(j, src, RBX, 0);
+	emit8(j, 0x01);
+	emit_mem(j, src, disp);
+}
+
+// Keep what is in host registers and where, while compiling
+
+static void reg_forget (Jit *j)
+{
+	memset(j->host, -1, sizeof(j->host));
+	memset(j->dirty, 0, sizeof(j->dirty));
+}
+
+static void reg_writeback (Jit *j)
+{
+	int x;
+	
+	for (x = 0; x < 16; x++)
+	{
+		if (j->dirty[x])
+		{
+			emit_store8(j, j->host[x], OFF_V(x));
+			j->dirty[x] = 0;
+		}
+	}
+}
+
+// Host register holding Vx, load says if the value is going to be read
+
+static int reg_get (Jit *j, u8 x, u8 load)
+{
+	int i, v, victim = -1;
+	u8 taken;
+	
+	if (j->host[x] < 0)
+	{
+		// A free one, or the least recently used
+		for (i = 0; i < POOL_SIZE && victim < 0; i++)
+		{
+			taken = 0;
+			for (v = 0; v < 16; v++)
+			{
+				if (j->host[v] == pool[i])
+				{
+					taken = 1;
+				}
+			}
+			if (!taken)
+			{
+				victim = pool[i];
+			}
+		}
+		if (victim < 0)
+		{
+			v = -1;
+			for (i = 0; i < 16; i++)
+			{
+				if (j->host[i] >= 0 && (v < 0 || j->used[i] < j->used[v]))
+				{
+					v = i;
+				}
+			}
+			if (j->dirty[v])
+			{
+				emit_store8(j, j->host[v], OFF_V(v));
+				j->dirty[v] = 0;
+			}
+			victim = j->host[v];
+			j->host[v] = -1;
+		}
+		j->host[x] = victim;
+		j->save[victim] = 1;
+		if (load)
+		{
+			emit_load8(j, victim, OFF_V(x));
+		}
+	}
+	j->used[x] = ++j->stamp;
+	return j->host[x];
+}
+
+static int reg_set (Jit *j, u8 x)
+{
+	int h = reg_get(j, x, 0);
+	
+	j->dirty[x] = 1;
+	return h;
+}
+
+// VF = ecx
+
+static void emit_set_vf (Jit *j)
+{
+	emit_mov(j, reg_set(j, 0xF), RCX);
+}
+
+// Call an instruction of ops.h, PC as the fetch leaves it
+
+static void emit_helper (Jit *j, void (*fn) (Machine *m, Instr *in), u16 address)
+{
+	reg_writeback(j);
+	reg_forget(j);
+	emit_store16_imm(j, OFF_PC, address + 1);
+	
+	// mov rdi, rbx; mov rsi, in; mov rax, fn; call rax
+	emit8(j, 0x48);
+	emit8(j, 0x89);
+	emit8(j, 0xDF);
+	emit8(j, 0x48);
+	emit8(j, 0xBE);
+	emit64(j, (unsigned long long) (size_t) &j->instrs[address]);
+	emit8(j, 0x48);
+	emit8(j, 0xB8);
+	emit64(j, (unsigned long long) (size_t) fn);
+	emit8(j, 0xFF);
+	emit8(j, 0xD0);
+}
+
+/*
+
+The helpers, ops.h is all inline so they need a body to be called.
+
+*/
+
+static void helper_cls (Machine *m, Instr *in) { op_cls(m, in); }
+static void helper_sys (Machine *m, Instr *in) { op_sys(m, in); }
+static void helper_rnd (Machine *m, Instr *in) { op_rnd(m, in); }
+static void helper_drw (Machine *m, Instr *in) { op_drw(m, in); }
+static void helper_skp (Machine *m, Instr *in) { op_skp(m, in); }
+static void helper_sknp (Machine *m, Instr *in) { op_sknp(m, in); }
+static void helper_ld_key (Machine *m, Instr *in) { op_ld_key(m, in); }
+static void helper_ld_b (Machine *m, Instr *in) { op_ld_b(m, in); }
+static void helper_ld_mem (Machine *m, Instr *in) { op_ld_mem(m, in, 0); }
+static void helper_ld_mem_keep (Machine *m, Instr *in) { op_ld_mem(m, in, QUIRK_KEEP_I); }
+static void helper_ld_reg_mem (Machine *m, Instr *in) { op_ld_reg_mem(m, in, 0); }
+static void helper_ld_reg_mem_keep (Machine *m, Instr *in) { op_ld_reg_mem(m, in, QUIRK_KEEP_I); }
+static void helper_scd (Machine *m, Instr *in) { op_scd(m, in); }
+static void helper_scr (Machine *m, Instr *in) { op_scr(m, in); }
+static void helper_scl (Machine *m, Instr *in) { op_scl(m, in); }
+static void helper_low (Machine *m, Instr *in) { op_low(m, in); }
+static void helper_high (Machine *m, Instr *in) { op_high(m, in); }
+static void helper_ld_hf (Machine *m, Instr *in) { op_ld_hf(m, in); }
+static void helper_ld_r (Machine *m, Instr *in) { op_ld_r(m, in); }
+static void helper_ld_vx_r (Machine *m, Instr *in) { op_ld_vx_r(m, in); }
+
+// Push rbx and the callee saved registers used, keeping the stack aligned for calls
+
+static void emit_prologue (Jit *j)
+{
+	int r, pushes = 1;
+	
+	emit8(j, 0x53);
+	for (r = 5; r < 16; r++)
+	{
+		if (j->save[r] && (r == RBP || r >= 12))
+		{
+			emit_rex(j, 0, r, 0);
+			emit8(j, 0x50 + (r & 7));
+			pushes++;
+		}
+	}
+	if (!(pushes & 1))
+	{
+		// sub rsp, 8
+		emit8(j, 0x48);
+		emit8(j, 0x83);
+		emit8(j, 0xEC);
+		emit8(j, 0x08);
+	}
+	// mov rbx, rdi
+	emit8(j, 0x48);
+	emit8(j, 0x89);
+	emit8(j, 0xFB);
+}
+
+static void emit_epilogue (Jit *j)
+{
+	int r, pushes = 1;
+	
+	for (r = 5; r < 16; r++)
+	{
+		if (j->save[r] && (r == RBP || r >= 12))
+		{
+			pushes++;
+		}
+	}
+	if (!(pushes & 1))
+	{
+		// add rsp, 8
+		emit8(j, 0x48);
+		emit8(j, 0x83);
+		emit8(j, 0xC4);
+		emit8(j, 0x08);
+	}
+	for (r = 15; r >= 5; r--)
+	{
+		if (j->save[r] && (r == RBP || r >= 12))
+		{
+			emit_rex(j, 0, r, 0);
+			emit8(j, 0x58 + (r & 7));
+		}
+	}
+	emit8(j, 0x5B);
+	emit8(j, 0xC3);
+}
+
+// How a block leaves
+
+#define EXIT_NONE 0
+#define EXIT_CONST 1
+#define EXIT_RAX 2
+#define EXIT_DONE 3
+
+// Translate one instruction, returns how the block leaves after it
+
+static int compile_instr (Jit *j, Instr *in, u16 address, u16 *next)
+{
+	int hx, hy = 0;
+	
+	// The register shifted, Vy with QUIRK_SHIFT_VY
+	u8 s = (j->quirks & QUIRK_SHIFT_VY) ? in->y : in->x;
+	
+	*next = address + 2;
+	
+	switch (in->op)
+	{
+		case OP_LD_BYTE:
+			emit_mov_imm(j, reg_set(j, in->x), in->kk);
+			return EXIT_NONE;
+		case OP_ADD_BYTE:
+			hx = reg_get(j, in->x, 1);
+			emit_alu_imm(j, IMM_ADD, hx, in->kk);
+			emit_alu_imm(j, IMM_AND, hx, 0xFF);
+			j->dirty[in->x] = 1;
+			return EXIT_NONE;
+		case OP_LD_REG:
+			hy = reg_get(j, in->y, 1);
+			emit_mov(j, reg_set(j, in->x), hy);
+			return EXIT_NONE;
+		case OP_OR:
+		case OP_AND:
+		case OP_XOR:
+			hy = reg_get(j, in->y, 1);
+			hx = reg_get(j, in->x, 1);
+			emit_alu(j, in->op == OP_OR ? ALU_OR : in->op == OP_AND ? ALU_AND : ALU_XOR, hx, hy);
+			j->dirty[in->x] = 1;
+			return EXIT_NONE;
+		case OP_ADD_REG:
+			// Carry is bit 8 of the sum, VF first and then Vx as the interpreter
+			hx = reg_get(j, in->x, 1);
+			hy = reg_get(j, in->y, 1);
+			emit_mov(j, RAX, hx);
+			emit_alu(j, ALU_ADD, RAX, hy);
+			emit_mov(j, RCX, RAX);
+			emit_shift(j, SHIFT_SHR, RCX, 8);
+			emit_set_vf(j);
+			hx = reg_set(j, in->x);
+			emit_mov(j, hx, RAX);
+			emit_alu_imm(j, IMM_AND, hx, 0xFF);
+			return EXIT_NONE;
+		case OP_SUB:
+		case OP_SUBN:
+			hx = reg_get(j, in->x, 1);
+			hy = reg_get(j, in->y, 1);
+			emit_alu(j, ALU_XOR, RCX, RCX);
+			if (in->op == OP_SUB)
+			{
+				emit_alu(j, ALU_CMP, hx, hy);
+			}
+			else
+			{
+				emit_alu(j, ALU_CMP, hy, hx);
+			}
+			emit_setcc(j, CC_A);
+			emit_set_vf(j);
+			hx = reg_get(j, in->x, 1);
+			hy = reg_get(j, in->y, 1);
+			emit_alu(j, ALU_SUB, hx, hy);
+			emit_alu_imm(j, IMM_AND, hx, 0xFF);
+			j->dirty[in->x] = 1;
+			return EXIT_NONE;
+		case OP_SHR:
+			emit_mov(j, RCX, reg_get(j, s, 1));
+			emit_alu_imm(j, IMM_AND, RCX, 1);
+			emit_set_vf(j);
+			hy = reg_get(j, s, 1);
+			hx = reg_set(j, in->x);
+			if (hx != hy)
+			{
+				emit_mov(j, hx, hy);
+			}
+			emit_shift(j, SHIFT_SHR, hx, 1);
+			return EXIT_NONE;
+		case OP_SHL:
+			emit_mov(j, RCX, reg_get(j, s, 1));
+			emit_shift(j, SHIFT_SHR, RCX, 7);
+			emit_set_vf(j);
+			hy = reg_get(j, s, 1);
+			hx = reg_set(j, in->x);
+			if (hx != hy)
+			{
+				emit_mov(j, hx, hy);
+			}
+			emit_shift(j, SHIFT_SHL, hx, 1);
+			emit_alu_imm(j, IMM_AND, hx, 0xFF);
+			return EXIT_NONE;
+		case OP_LD_I:
+			emit_store16_imm(j, OFF_I, in->nnn);
+			return EXIT_NONE;
+		case OP_LD_VX_DT:
+			emit_load8(j, reg_set(j, in->x), OFF_DT);
+			return EXIT_NONE;
+		case OP_LD_DT:
+			emit_store16(j, reg_get(j, in->x, 1), OFF_DT);
+			return EXIT_NONE;
+		case OP_LD_ST:
+			emit_store16(j, reg_get(j, in->x, 1), OFF_ST);
+			return EXIT_NONE;
+		case OP_ADD_I:
+			emit_add16(j, reg_get(j, in->x, 1), OFF_I);
+			return EXIT_NONE;
+		case OP_LD_F:
+			// lea eax, [rax + rax*4]
+			emit_mov(j, RAX, reg_get(j, in->x, 1));
+			emit8(j, 0x8D);
+			emit8(j, 0x04);
+			emit8(j, 0x80);
+			emit_store16(j, RAX, OFF_I);
+			return EXIT_NONE;
+		case OP_CLS:
+			emit_helper(j, helper_cls, address);
+			return EXIT_NONE;
+		case OP_SYS:
+			emit_helper(j, helper_sys, address);
+			return EXIT_NONE;
+		case OP_RND:
+			emit_helper(j, helper_rnd, address);
+			return EXIT_NONE;
+		case OP_DRW:
+			emit_helper(j, helper_drw, address);
+			return EXIT_NONE;
+		case OP_LD_REG_MEM:
+			emit_helper(j, (j->quirks & QUIRK_KEEP_I) ? helper_ld_reg_mem_keep : helper_ld_reg_mem, address);
+			return EXIT_NONE;
+		case OP_SCD:
+			emit_helper(j, helper_scd, address);
+			return EXIT_NONE;
+		case OP_SCR:
+			emit_helper(j, helper_scr, address);
+			return EXIT_NONE;
+		case OP_SCL:
+			emit_helper(j, helper_scl, address);
+			return EXIT_NONE;
+		case OP_LOW:
+			emit_helper(j, helper_low, address);
+			return EXIT_NONE;
+		case OP_HIGH:
+			emit_helper(j, helper_high, address);
+			return EXIT_NONE;
+		case OP_LD_HF:
+			emit_helper(j, helper_ld_hf, address);
+			return EXIT_NONE;
+		case OP_LD_R:
+			emit_helper(j, helper_ld_r, address);
+			return EXIT_NONE;
+		case OP_LD_VX_R:
+			emit_helper(j, helper_ld_vx_r, address);
+			return EXIT_NONE;
+		
+		// Instructions that end the block
+		
+		case OP_JP:
+			*next = in->nnn;
+			return EXIT_CONST;
+		case OP_CALL:
+			// movzx eax, SP; add eax, 1; mov SP, al; and eax, 0xF
+			emit_load8(j, RAX, OFF_SP);
+			emit_alu_imm(j, IMM_ADD, RAX, 1);
+			emit_store8(j, RAX, OFF_SP);
+			emit_alu_imm(j, IMM_AND, RAX, 0xF);
+			// mov word [rbx + rax*2 + stack], address + 2
+			emit8(j, 0x66);
+			emit8(j, 0xC7);
+			emit8(j, 0x84);
+			emit8(j, 0x43);
+			emit32(j, OFF_STACK);
+			emit16(j, address + 2);
+			*next = in->nnn;
+			return EXIT_CONST;
+		case OP_RET:
+			emit_load8(j, RAX, OFF_SP);
+			emit_alu_imm(j, IMM_AND, RAX, 0xF);
+			// movzx eax, word [rbx + rax*2 + stack]; dec byte SP
+			emit8(j, 0x0F);
+			emit8(j, 0xB7);
+			emit8(j, 0x84);
+			emit8(j, 0x43);
+			emit32(j, OFF_STACK);
+			emit8(j, 0xFE);
+			emit_mem(j, 1, OFF_SP);
+			return EXIT_RAX;
+		case OP_JP_V0:
+			emit_mov(j, RAX, reg_get(j, (j->quirks & QUIRK_JUMP_VX) ? in->x : 0, 1));
+			emit_alu_imm(j, IMM_ADD, RAX, in->nnn);
+			return EXIT_RAX;
+		case OP_SE_BYTE:
+		case OP_SNE_BYTE:
+		case OP_SE_REG:
+		case OP_SNE_REG:
+			hx = reg_get(j, in->x, 1);
+			if (in->op == OP_SE_REG || in->op == OP_SNE_REG)
+			{
+				hy = reg_get(j, in->y, 1);
+			}
+			emit_mov_imm(j, RAX, address + 2);
+			emit_mov_imm(j, RCX, address + 4);
+			if (in->op == OP_SE_REG || in->op == OP_SNE_REG)
+			{
+				emit_alu(j, ALU_CMP, hx, hy);
+			}
+			else
+			{
+				emit_alu_imm(j, IMM_CMP, hx, in->kk);
+			}
+			emit_cmov(j, (in->op == OP_SE_BYTE || in->op == OP_SE_REG) ? CC_E : CC_NE, RAX, RCX);
+			return EXIT_RAX;
+		case OP_SKP:
+			emit_helper(j, helper_skp, address);
+			return EXIT_DONE;
+		case OP_SKNP:
+			emit_helper(j, helper_sknp, address);
+			return EXIT_DONE;
+		case OP_LD_KEY:
+			emit_helper(j, helper_ld_key, address);
+			return EXIT_DONE;
+		case OP_LD_B:
+			emit_helper(j, helper_ld_b, address);
+			return EXIT_DONE;
+		case OP_LD_MEM:
+			emit_helper(j, (j->quirks & QUIRK_KEEP_I) ? helper_ld_mem_keep : helper_ld_mem, address);
+			return EXIT_DONE;
+		default:
+			return -1;
+	}
+}
+
+static int jit_protect (Jit *j, u8 *at, int prot)
+{
+	// Pages a block compiled at at can reach, 0 when they could not be changed
+	
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t from = (uintptr_t) at & ~(page - 1);
+	uintptr_t to = (uintptr_t) at + JIT_BLOCK_SIZE;
+	
+	if (to > (uintptr_t) j->code + JIT_CODE_SIZE)
+	{
+		to = (uintptr_t) j->code + JIT_CODE_SIZE;
+	}
+	return mprotect((void *) from, to - from, prot) == 0;
+}
+
+static Block *jit_compile (Machine *m, u16 start)
+{
+	Jit *j = m->jit;
+	Block *b;
+	Instr *in;
+	u16 address = start, next;
+	u8 count = 0, *body;
+	int exit = EXIT_NONE, a;
+	size_t size;
+	
+	if (j->nblocks == JIT_BLOCKS || j->p + JIT_BLOCK_SIZE > j->code + JIT_CODE_SIZE)
+	{
+		jit_flush(m);
+	}
+	
+	// Code is never writable and executable at once, only while a block is written
+	if (!jit_protect(j, j->p, PROT_READ | PROT_WRITE))
+	{
+		j->refused[start] = 1;
+		return NULL;
+	}
+	b = &j->blocks[j->nblocks];
+	b->code = (void (*) (Machine *)) j->p;
+	j->quirks = m->quirks;
+	
+	// The body goes after room for the longest prologue, moved back once it is known
+	j->p += JIT_PROLOGUE_MAX;
+	memset(j->save, 0, sizeof(j->save));
+	
+	reg_forget(j);
+	while (exit == EXIT_NONE && count < JIT_BLOCK_MAX && address < 0xFFF)
+	{
+		in = &j->instrs[address];
+		instr_decode(in, m->memory[address] << 8 | m->memory[address + 1]);
+		exit = compile_instr(j, in, address, &next);
+		if (exit < 0)
+		{
+			// Left to the interpreter
+			break;
+		}
+		count++;
+		address += 2;
+	}
+	if (count == 0)
+	{
+		j->p = (u8 *) b->code;
+		if (!jit_protect(j, (u8 *) b->code, PROT_READ | PROT_EXEC))
+		{
+			// Blocks before it on the same pages can not run any more
+			jit_flush(m);
+		}
+		j->refused[start] = 1;
+		return NULL;
+	}
+	
+	reg_writeback(j);
+	if (exit == EXIT_RAX)
+	{
+		emit_store16(j, RAX, OFF_PC);
+	}
+	else if (exit == EXIT_CONST)
+	{
+		emit_store16_imm(j, OFF_PC, next);
+	}
+	else if (exit != EXIT_DONE)
+	{
+		emit_store16_imm(j, OFF_PC, address);
+	}
+	emit_store16_imm(j, OFF_IR, j->instrs[address - 2].ir);
+	
+	emit_epilogue(j);
+	
+	body = (u8 *) b->code + JIT_PROLOGUE_MAX;
+	size = j->p - body;
+	j->p = (u8 *) b->code;
+	emit_prologue(j);
+	memmove(j->p, body, size);
+	if (!jit_protect(j, (u8 *) b->code, PROT_READ | PROT_EXEC))
+	{
+		jit_flush(m);
+		j->refused[start] = 1;
+		return NULL;
+	}
+	j->p += size;
+	
+	b->start = start;
+	b->end = address;
+	b->count = count;
+	b->idle = (j->instrs[start].op == OP_LD_VX_DT);
+	for (a = start; a < address; a++)
+	{
+		j->covered[a]++;
+	}
+	j->map[start] = b;
+	j->nblocks++;
+	return b;
+}
+
+void jit_run (Machine *m, unsigned int left)
+{
+	Block *b;
+	
+	if (m->jit == NULL)
+	{
+		m->jit = calloc(1, sizeof(Jit));
+		if (m->jit != NULL)
+		{
+			m->jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (m->jit->code == MAP_FAILED)
+			{
+				free(m->jit);
+				m->jit = NULL;
+			}
+			else
+			{
+				m->jit->p = m->jit->code;
+			}
+		}
+		if (m->jit == NULL)
+		{
+			// No executable memory, the threaded engine does it
+			m->engine = ENGINE_THREADED;
+			threaded_run(m, left);
+			return;
+		}
+	}
+	
+	while (left > 0)
+	{
+		b = NULL;
+		if (m->PC < 0xFFF && !m->jit->refused[m->PC])
+		{
+			b = m->jit->map[m->PC];
+			if (b == NULL)
+			{
+				b = jit_compile(m, m->PC);
+			}
+		}
+#ifndef NO_IDLE_LOOPS
+		if (b != NULL && b->idle && machine_idle(m, left))
+		{
+			return;
+		}
+#endif
+		if (b == NULL || b->count > left)
+		{
+			machine_step(m);
+			left--;
+		}
+		else
+		{
+			b->code(m);
+			left -= b->count;
+		}
+	}
+}
+
+void jit_invalidate (Machine *m, u16 address)
+{
+	// Throw away every block over address, the code stays until the next flush
+	
+	Jit *j = m->jit;
+	Block *b;
+	int s, a;
+	
+	j->refused[address] = 0;
+	if (address > 0)
+	{
+		j->refused[address - 1] = 0;
+	}
+	if (!j->covered[address])
+	{
+		return;
+	}
+	for (s = address - (JIT_BLOCK_MAX * 2 - 1); s <= address; s++)
+	{
+		if (s < 0)
+		{
+			continue;
+		}
+		b = j->map[s];
+		if (b != NULL && address < b->end)
+		{
+			for (a = b->start; a < b->end; a++)
+			{
+				j->covered[a]--;
+			}
+			j->map[s] = NULL;
+		}
+	}
+}
+
+void jit_flush (Machine *m)
+{
+	Jit *j = m->jit;
+	
+	memset(j->map, 0, sizeof(j->map));
+	memset(j->covered, 0, sizeof(j->covered));
+	memset(j->refused, 0, sizeof(j->refused));
+	j->nblocks = 0;
+	j->p = j->code;
+}
+
+void jit_free (Machine *m)
+{
+	if (m->jit != NULL)
+	{
+		munmap(m->jit->code, JIT_CODE_SIZE);
+		free(m->jit);
+		m->jit = NULL;
+	}
+}
+
+#else
+
+// Not an x86-64, the threaded engine runs instead
+
+void jit_run (Machine *m, unsigned int left)
+{
+	m->engine = ENGINE_THREADED;
+	threaded_run(m, left);
+}
+
+void jit_invalidate (Machine *m, u16 address)
+{
+}
+
+void jit_flush (Machine *m)
+{
+}
+
+void jit_free (Machine *m)
+{
+}
+
+#endif
@@ -0,0 +1,657 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+/*
+
+Jobs
+
+Runs a list of jobs headlessly on every core of the host. A job is a ROM
+run for some frames with a seed and maybe a script for the keys, one per
+line of the job file, the ROM first and then any of
+
+	frames n        frames to run, 600 by default
+	seed n          seed for random numbers, else the one of the script, else 1
+	input file      script or recording with the keys, none pressed without it
+	ipf n           instructions per frame, CLOCK by default
+	engine name     switch (default), cache, threaded, jit or aot
+	quirks list     quirks instead of the ROM's, as -quirks of chip8
+	output list     hash, regs, display or all, comma separated, hash by default
+
+Lines starting with # are ignored, paths can not have spaces.
+
+	# ten seconds of PONG with two seeds, and BLITZ with a recording
+	roms/PONG frames 600 seed 1
+	roms/PONG frames 600 seed 2 output hash,regs
+	roms/BLITZ input blitz.txt output all
+
+Every job has a machine and a script of its own and nothing else is shared
+between them but the output, so they run on as many threads as there are
+cores. Each thread starts with a slice of the list and takes jobs from the
+bottom of it; once it runs out it steals from the top of the slice of
+another, so a few long jobs do not leave the rest of the threads idle.
+
+Results go to a single file as they finish, one JSON object per line, with
+"job" the index of the job in the list. The framebuffer hash is FNV-1a over
+the lines of Display, 8 bytes each with the leftmost pixels first, or 16
+in the high resolution of the SUPER-CHIP.
+
+	./chip8-jobs -threads 4 -o results.jsonl jobs.txt
+
+*/
+
+#include "machine.h"
+#include "script.h"
+#include "sched.h"
+#include <unistd.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stdarg.h>
+
+// The counters of profile.c are shared by the whole process, so threads
+// running jobs side by side would count over each other
+
+#ifdef PROFILE
+#error "chip8-jobs can not be built with -DPROFILE, profile one job with chip8-headless"
+#endif
+
+#define JOB_FRAMES 600
+#define JOB_SEED 1
+
+// Longest line of the job file and of a result
+
+#define JOB_LINE 1024
+#define RESULT_LINE 16384
+
+// What a job writes besides its status and timing
+
+#define OUTPUT_HASH 1
+#define OUTPUT_REGS 2
+#define OUTPUT_DISPLAY 4
+
+typedef struct Job
+{
+	char *rom;
+	char *input;
+	unsigned long frames;
+	u32 seed;
+	u8 has_seed;
+	unsigned int ipf;
+	u8 engine;
+	u8 quirks;
+	u8 has_quirks;
+	u8 output;
+} Job;
+
+/*
+
+Slice of the list owned by a thread, jobs from top to bottom - 1.
+The owner takes from the bottom, thieves from the top.
+
+*/
+
+typedef struct Deque
+{
+	pthread_mutex_t lock;
+	int top;
+	int bottom;
+} Deque;
+
+typedef struct Pool
+{
+	Job *jobs;
+	int count;
+	Deque *deques;
+	int threads;
+	FILE *out;
+	pthread_mutex_t out_lock;
+	int failed;
+} Pool;
+
+typedef struct Worker
+{
+	Pool *pool;
+	int id;
+} Worker;
+
+static const char *engine_names[] = { "switch", "cache", "threaded", "jit", "aot" };
+
+void usage(char *name)
+{
+	printf("Usage: %s [options] jobs\n", name);
+	printf("  -threads n     threads to run the jobs on, one per core by default\n");
+	printf("  -o file        where the results go, standard output by default\n");
+}
+
+char *copy(char *text)
+{
+	char *c = malloc(strlen(text) + 1);
+	
+	if (c == NULL)
+	{
+		exit(1);
+	}
+	strcpy(c, text);
+	return c;
+}
+
+int parse_output(char *list, u8 *output)
+{
+	char *word, *save;
+	
+	*output = 0;
+	for (word = strtok_r(list, ",", &save); word != NULL; word = strtok_r(NULL, ",", &save))
+	{
+		if (strcmp(word, "hash") == 0)
+		{
+			*output |= OUTPUT_HASH;
+		}
+		else if (strcmp(word, "regs") == 0)
+		{
+			*output |= OUTPUT_REGS;
+		}
+		else if (strcmp(word, "display") == 0)
+		{
+			*output |= OUTPUT_DISPLAY;
+		}
+		else if (strcmp(word, "all") == 0)
+		{
+			*output |= OUTPUT_HASH | OUTPUT_REGS | OUTPUT_DISPLAY;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int parse_job(char *line, Job *job)
+{
+	// 1 for a job, 0 for a line without one, -1 for a mistake
+	
+	char *key, *value, *save;
+	int e;
+	
+	key = strtok_r(line, " \t\r\n", &save);
+	if (key == NULL || key[0] == '#')
+	{
+		return 0;
+	}
+	job->rom = copy(key);
+	job->input = NULL;
+	job->frames = JOB_FRAMES;
+	job->seed = JOB_SEED;
+	job->has_seed = 0;
+	job->ipf = CLOCK;
+	job->engine = ENGINE_SWITCH;
+	job->has_quirks = 0;
+	job->output = OUTPUT_HASH;
+	
+	while ((key = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+	{
+		value = strtok_r(NULL, " \t\r\n", &save);
+		if (value == NULL)
+		{
+			return -1;
+		}
+		if (strcmp(key, "frames") == 0)
+		{
+			job->frames = strtoul(value, NULL, 10);
+		}
+		else if (strcmp(key, "seed") == 0)
+		{
+			job->seed = strtoul(value, NULL, 0);
+			job->has_seed = 1;
+		}
+		else if (strcmp(key, "input") == 0)
+		{
+			job->input = copy(value);
+		}
+		else if (strcmp(key, "ipf") == 0)
+		{
+			job->ipf = strtoul(value, NULL, 10);
+		}
+		else if (strcmp(key, "engine") == 0)
+		{
+			for (e = ENGINE_AOT; e >= 0 && strcmp(value, engine_names[e]) != 0; e--)
+			{
+			}
+			if (e < 0)
+			{
+				return -1;
+			}
+			job->engine = e;
+		}
+		else if (strcmp(key, "quirks") == 0)
+		{
+			if (!quirks_parse(value, &job->quirks))
+			{
+				return -1;
+			}
+			job->has_quirks = 1;
+		}
+		else if (strcmp(key, "output") == 0)
+		{
+			if (!parse_output(value, &job->output))
+			{
+				return -1;
+			}
+		}
+		else
+		{
+			return -1;
+		}
+	}
+	return 1;
+}
+
+int read_jobs(char *file_name, Job **jobs)
+{
+	// Number of jobs in the file, -1 when it can not be read
+	
+	char line[JOB_LINE];
+	int count = 0, size = 0, number = 0, got;
+	FILE *file;
+	Job *grown;
+	
+	file = fopen(file_name, "r");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Error, not found %s.\n", file_name);
+		return -1;
+	}
+	*jobs = NULL;
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		number++;
+		if (count == size)
+		{
+			size = size == 0 ? 64 : size * 2;
+			grown = realloc(*jobs, size * sizeof(Job));
+			if (grown == NULL)
+			{
+				exit(1);
+			}
+			*jobs = grown;
+		}
+		got = parse_job(line, &(*jobs)[count]);
+		if (got < 0)
+		{
+			fprintf(stderr, "%s:%d: bad job\n", file_name, number);
+			fclose(file);
+			return -1;
+		}
+		count += got;
+	}
+	fclose(file);
+	return count;
+}
+
+int take(Pool *pool, int id)
+{
+	// Next job for thread id, its own or stolen, -1 when they are all taken
+	
+	Deque *d;
+	int i, job = -1;
+	
+	d = &pool->deques[id];
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom > d->top)
+	{
+		job = --d->bottom;
+	}
+	pthread_mutex_unlock(&d->lock);
+	
+	// Nothing ever goes back in, so when every slice is empty it is over
+	for (i = 1; job < 0 && i < pool->threads; i++)
+	{
+		d = &pool->deques[(id + i) % pool->threads];
+		pthread_mutex_lock(&d->lock);
+		if (d->bottom > d->top)
+		{
+			job = d->top++;
+		}
+		pthread_mutex_unlock(&d->lock);
+	}
+	return job;
+}
+
+int put_string(char *out, int size, char *text)
+{
+	// JSON string, only " and \ and control characters need escaping
+	
+	int n = 0;
+	
+	n += snprintf(out + n, size - n, "\"");
+	for (; *text != '\0' && n < size - 8; text++)
+	{
+		if (*text == '"' || *text == '\\')
+		{
+			n += snprintf(out + n, size - n, "\\%c", *text);
+		}
+		else if ((unsigned char) *text < 0x20)
+		{
+			n += snprintf(out + n, size - n, "\\u%04x", *text);
+		}
+		else
+		{
+			out[n++] = *text;
+		}
+	}
+	n += snprintf(out + n, size - n, "\"");
+	return n;
+}
+
+int put_format(char *result, int n, const char *format, ...)
+{
+	// printf at n of a result, cut at RESULT_LINE, returns where the text ends now
+	
+	va_list args;
+	int size = RESULT_LINE - n, got;
+	
+	if (size <= 1)
+	{
+		return n;
+	}
+	va_start(args, format);
+	got = vsnprintf(result + n, size, format, args);
+	va_end(args);
+	if (got < 0)
+	{
+		return n;
+	}
+	return got < size ? n + got : RESULT_LINE - 1;
+}
+
+unsigned long display_hash(Machine *m)
+{
+	u8 bytes[Y_HIRES * 16];
+	int y, b, size = COLUMNS(m) / 8;
+	
+	for (y = 0; y < LINES(m); y++)
+	{
+		for (b = 0; b < size; b++)
+		{
+			bytes[y * size + b] = m->Display[y][b >> 3] >> (56 - 8 * (b & 7));
+		}
+	}
+	return rom_hash(bytes, LINES(m) * size);
+}
+
+void run_job(Pool *pool, int index)
+{
+	Job *job = &pool->jobs[index];
+	char result[RESULT_LINE], line[X_HIRES + 1];
+	char *error = NULL;
+	Machine *m;
+	Script script;
+	u8 has_script = 0;
+	unsigned long long instructions = 0;
+	unsigned long until;
+	u32 seed = job->seed;
+	double start, seconds = 0;
+	int n = 0, i, x, y, got;
+	
+	m = malloc(sizeof(Machine));
+	if (m == NULL)
+	{
+		exit(1);
+	}
+	machine_init(m);
+	m->engine = job->engine;
+	m->ipf = job->ipf;
+	if (read_rom(m) != LOAD_OK)
+	{
+		error = "CHIP8.ROM not found";
+	}
+	else if ((got = read_game(m, job->rom)) != LOAD_OK)
+	{
+		error = got == LOAD_TOO_BIG ? "ROM too big" : "ROM not found";
+	}
+	else if (job->input != NULL && !script_open(&script, job->input))
+	{
+		error = "input not found";
+	}
+	else
+	{
+		if (job->has_quirks)
+		{
+			m->quirks = job->quirks;
+			machine_flush(m);
+		}
+		has_script = job->input != NULL;
+		if (has_script && !job->has_seed && script.has_seed)
+		{
+			seed = script.seed;
+		}
+		machine_seed(m, seed);
+		
+		start = sched_now();
+		while (m->frame < job->frames)
+		{
+			m->keys = has_script ? script_keys(&script, m->frame) : 0;
+			if (!(m->waiting && m->keys == 0))
+			{
+				instructions += m->ipf;
+			}
+			machine_run(m);
+			if (m->waiting && m->frame < job->frames)
+			{
+				// Nothing happens until the keys change, jump there
+				until = has_script ? script_next_change(&script) : ULONG_MAX;
+				if (until > job->frames)
+				{
+					until = job->frames;
+				}
+				if (until > m->frame)
+				{
+					machine_skip(m, until - m->frame);
+				}
+			}
+		}
+		seconds = sched_now() - start;
+	}
+	
+	n = put_format(result, n, "{\"job\": %d, \"rom\": ", index);
+	n += put_string(result + n, sizeof(result) - n, job->rom);
+	n = put_format(result, n, ", \"engine\": \"%s\", \"frames\": %lu, ",
+		engine_names[job->engine], m->frame);
+	if (error != NULL)
+	{
+		n = put_format(result, n, "\"error\": \"%s\"}\n", error);
+	}
+	else
+	{
+		n = put_format(result, n, "\"seed\": %u, \"seconds\": %.6f, \"instructions\": %llu",
+			seed, seconds, instructions);
+		if (job->output & OUTPUT_HASH)
+		{
+			n = put_format(result, n, ", \"hash\": \"%08lx\"", display_hash(m));
+		}
+		if (job->output & OUTPUT_REGS)
+		{
+			n = put_format(result, n, ", \"V\": [");
+			for (i = 0; i < 16; i++)
+			{
+				n = put_format(result, n, "%s%u", i == 0 ? "" : ", ", m->V[i]);
+			}
+			n = put_format(result, n, "], \"I\": %u, \"PC\": %u, \"SP\": %u, \"DT\": %u, \"ST\": %u",
+				m->I, m->PC, m->SP, m->DT, m->ST);
+		}
+		if (job->output & OUTPUT_DISPLAY)
+		{
+			// Same as the headless build prints it, a string per line
+			n = put_format(result, n, ", \"display\": [");
+			for (y = 0; y < LINES(m); y++)
+			{
+				for (x = 0; x < COLUMNS(m); x++)
+				{
+					line[x] = PIXEL(m, x, y) ? '#' : '.';
+				}
+				line[x] = '\0';
+				n = put_format(result, n, "%s\"%s\"", y == 0 ? "" : ", ", line);
+			}
+			n = put_format(result, n, "]");
+		}
+		n = put_format(result, n, "}\n");
+	}
+	if (n == RESULT_LINE - 1)
+	{
+		// Cut short, but still a line of its own
+		result[n - 1] = '\n';
+	}
+	if (has_script)
+	{
+		script_close(&script);
+	}
+	machine_free(m);
+	free(m);
+	
+	// A whole line at a time, so they never get mixed
+	pthread_mutex_lock(&pool->out_lock);
+	fputs(result, pool->out);
+	fflush(pool->out);
+	if (error != NULL)
+	{
+		pool->failed++;
+	}
+	pthread_mutex_unlock(&pool->out_lock);
+}
+
+void *worker(void *arg)
+{
+	Worker *w = arg;
+	int job;
+	
+	while ((job = take(w->pool, w->id)) >= 0)
+	{
+		run_job(w->pool, job);
+	}
+	return NULL;
+}
+
+int main(int argv, char *argc[])
+{
+	char *jobs_name = NULL, *out_name = NULL;
+	int threads = 0, arg, t;
+	Pool pool;
+	Worker *workers;
+	pthread_t *ids;
+	u8 *started;
+	
+	for (arg = 1; arg < argv; arg++)
+	{
+		if (strcmp(argc[arg], "-threads") == 0 && arg + 1 < argv)
+		{
+			threads = strtoul(argc[++arg], NULL, 10);
+		}
+		else if (strcmp(argc[arg], "-o") == 0 && arg + 1 < argv)
+		{
+			out_name = argc[++arg];
+		}
+		else if (argc[arg][0] == '-' || jobs_name != NULL)
+		{
+			usage(argc[0]);
+			return 1;
+		}
+		else
+		{
+			jobs_name = argc[arg];
+		}
+	}
+	if (jobs_name == NULL)
+	{
+		usage(argc[0]);
+		return 1;
+	}
+	
+	pool.count = read_jobs(jobs_name, &pool.jobs);
+	if (pool.count < 0)
+	{
+		return 1;
+	}
+	pool.out = stdout;
+	if (out_name != NULL)
+	{
+		pool.out = fopen(out_name, "w");
+		if (pool.out == NULL)
+		{
+			fprintf(stderr, "Error, can not write %s.\n", out_name);
+			return 1;
+		}
+	}
+	if (threads <= 0)
+	{
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (threads > pool.count)
+	{
+		threads = pool.count;
+	}
+	if (threads < 1)
+	{
+		threads = 1;
+	}
+	pool.threads = threads;
+	pool.failed = 0;
+	pthread_mutex_init(&pool.out_lock, NULL);
+	
+	// Slices of the list in order, thread t gets the t-th
+	pool.deques = malloc(threads * sizeof(Deque));
+	workers = malloc(threads * sizeof(Worker));
+	ids = malloc(threads * sizeof(pthread_t));
+	started = malloc(threads);
+	if (pool.deques == NULL || workers == NULL || ids == NULL || started == NULL)
+	{
+		return 1;
+	}
+	for (t = 0; t < threads; t++)
+	{
+		pthread_mutex_init(&pool.deques[t].lock, NULL);
+		pool.deques[t].top = (long) pool.count * t / threads;
+		pool.deques[t].bottom = (long) pool.count * (t + 1) / threads;
+		workers[t].pool = &pool;
+		workers[t].id = t;
+	}
+	
+	// This thread is the first worker, a slice whose thread did not start gets stolen
+	for (t = 1; t < threads; t++)
+	{
+		started[t] = pthread_create(&ids[t], NULL, worker, &workers[t]) == 0;
+	}
+	worker(&workers[0]);
+	for (t = 1; t < threads; t++)
+	{
+		if (started[t])
+		{
+			pthread_join(ids[t], NULL);
+		}
+	}
+	
+	if (out_name != NULL)
+	{
+		fclose(pool.out);
+	}
+	for (t = 0; t < pool.count; t++)
+	{
+		free(pool.jobs[t].rom);
+		free(pool.jobs[t].input);
+	}
+	free(pool.jobs);
+	free(pool.deques);
+	free(workers);
+	free(ids);
+	free(started);
+	return pool.failed != 0;
+}
@@ -1,984 +1,1304 @@
-/*
-
-The MIT License
-
-Copyright (c) 2009 Facon
-
-Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
-
-*/
-
-#include "machine.h"
-
-// Memory 4 KB (4,096 bytes) of RAM
-
-extern u8 memory[4096];
-
-// Registers from V0 to VF
-
-extern u8 V[16];
-
-// Register for save 16 bits address
-
-extern u16 I;
-
-// Instruction Register
-
-extern u16 IR;
-
-// Program Counter
-
-extern u16 PC;
-
-// Stack, array of 16 positions, 16 bits each block
-
-extern u16 stack[16];
-
-// Stack Pointer
-
-extern u16 *SP;
-
-/*
-
-Timers
-
-delay timer and sound timer
-
-delay timer
-
-sound timer when non-zero make a beep
-
-both runs at 60 Hz (60 cycles)
-
-*/
-
-extern u16 DT;
-extern u16 ST;
-
-// Display
-extern u8 Display [64][32];
-extern SDL_Surface *scr;
-
-u16 BIN2BCD (u8 a, short b);
-void draw_sprite(u8 x, u8 y, u8 n);
-char keyboard_event(SDL_Event* keyboard);
-
-void instruction_execute (SDL_Event *Events)
-{
-	u8 x;
-	u8 y;
-	u8 kk;
-	u8 z;
-	u16 i;
-	u8 n;
-	
-	u8 xpix, yline;
-	
-	char key_value;
-	
-	switch (IR >> 12)
-	{
-		case 0x0:
-			if (IR == 0x00E0)
-			{
-				/*
-			
-				00E0 - CLS
-				Clear the display.
-			
-				*/
-				
-				PC++;
-			
-				for (y = 0; y < Y_MAX; y++)
-					for (x = 0; x < X_MAX; x++)
-					{
-						Display[x][y] = 0;
-					}
-				
-				//printf("0x00E0 - CLS\n");
-			}
-			else if (IR == 0x00EE)
-			{
-				/*
-				
-				00EE - RET
-				Return from a subroutine.
-
-				The interpreter sets the program counter to the address at the top of the stack,
-				then subtracts 1 from the stack pointer.
-				
-				*/
-				
-				PC = *SP;
-				SP--;
-				//printf("0x00EE - RET\n");
-			}
-			else
-			{
-				/*
-		
-				0nnn - SYS addr
-				Jump to a machine code routine at nnn.
-
-				This instruction is only used on the old computers on which Chip-8 was originally implemented.
-				It is ignored by modern interpreters.
-				
-				*/
-				
-				PC++;
-				getchar();
-				//printf("0x0nnn - SYS nnn\n");
-			}
-			break;
-		case 0x1:
-			/*
-			
-			1nnn - JP addr
-			Jump to location nnn.
-
-			The interpreter sets the program counter to nnn.
-			
-			*/
-			
-			PC = (IR & 0x0FFF);
-			//printf("0x1%03X - JP 0x%03X\n", PC, PC);
-			break;
-		case 0x2:
-			/*
-			
-			2nnn - CALL addr
-			Call subroutine at nnn.
-
-			The interpreter increments the stack pointer, then puts the current PC on the top of the stack.
-			The PC is then set to nnn.
-			
-			*/
-			
-			PC++;
-			SP++;
-			*SP = PC;
-			PC = (IR & 0x0FFF);
-			//printf("0x2%03X - CALL 0x%03X\n", PC, PC);
-			break;
-		case 0x3:
-			/*
-			
-			3xkk - SE Vx, byte
-			Skip next instruction if Vx = kk.
-
-			The interpreter compares register Vx to kk, and if they are equal,
-			increments the program counter by 2
-			
-			*/
-			
-			PC++;
-				
-			x = ((IR & 0x0F00) >> 8);
-			kk = (IR & 0x00FF);
-			
-			if (V[x] == kk)
-			{
-				PC += 2;
-			}
-			
-			//printf("0x3%X%02X - SE V%X, 0x%02X\n", x, kk, x, kk);
-			break;
-		case 0x4:
-			/*
-			
-			4xkk - SNE Vx, byte
-			Skip next instruction if Vx != kk.
-
-			The interpreter compares register Vx to kk, and if they are not equal,
-			increments the program counter by 2.
-			
-			*/
-			
-			PC++;
-			
-			x = ((IR & 0x0F00) >> 8);
-			kk = (IR & 0x00FF);
-			
-			if (V[x] != kk)
-			{
-				PC += 2;
-			}
-			
-			//printf("0x4%X%02X - SNE V%X, 0x%02X\n", x, kk, x, kk);
-			break;
-		case 0x5:
-			/*
-			
-			5xy0 - SE Vx, Vy
-			Skip next instruction if Vx = Vy.
-
-			The interpreter compares register Vx to register Vy, and if they are equal,
-			increments the program counter by 2.
-			
-			*/
-			
-			PC++;
-			
-			x = ((IR & 0x0F00) >> 8);
-			y = ((IR & 0x00F0) >> 4);
-			
-			if (V[x] == V[y])
-			{
-				PC += 2;
-			}
-			
-			//printf("0x5%X%X0 - SE V%X, V%X\n", x, y, x, y);
-			break;
-		case 0x6:
-			/*
-			
-			6xkk - LD Vx, byte
-			Set Vx = kk.
-
-			The interpreter puts the value kk into register Vx.
-			
-			*/
-			
-			PC++;
-			
-			x = ((IR & 0x0F00) >> 8);
-			kk = (IR & 0x00FF);
-			
-			V[x] = kk;
-			
-			//printf("0x6%X%02X - LD V%X, 0x%03X\n", x, kk, x, kk);
-			break;
-		case 0x7:
-			/*
-			
-			7xkk - ADD Vx, byte
-			Set Vx = Vx + kk.
-
-			Adds the value kk to the value of register Vx, then stores the result in Vx.
-			
-			*/
-			
-			PC++;
-			
-			x = ((IR & 0x0F00) >> 8);
-			kk = (IR & 0x00FF);
-			
-			V[x] += kk;
-			
-			//printf("0x7%X%02X - ADD V%X, 0x%02X\n", x, kk, x, kk);
-			break;
-		case 0x8:
-			switch (IR & 0x000F)
-			{
-				case 0x0:
-					/*
-					
-					8xy0 - LD Vx, Vy
-					Set Vx = Vy.
-
-					Stores the value of register Vy in register Vx.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					y = ((IR & 0x00F0) >> 4);
-					
-					V[x] = V[y];
-					
-					//printf("0x8%X%X0 - LD V%X, V%X\n", x, y, x, y);
-					break;
-				case 0x1:
-					/*
-					
-					8xy1 - OR Vx, Vy
-					Set Vx = Vx OR Vy.
-
-					Performs a bitwise OR on the values of Vx and Vy, then stores the result in Vx.
-					A bitwise OR compares the corrseponding bits from two values, and if either bit is 1,
-					then the same bit in the result is also 1. Otherwise, it is 0. 
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					y = ((IR & 0x00F0) >> 4);
-					
-					V[x] |= V[y];
-					
-					//printf("0x8%X%X1 - OR V%X, V%X\n", x, y, x, y);
-					break;
-				case 0x2:
-					/*
-					
-					8xy2 - AND Vx, Vy
-					Set Vx = Vx AND Vy.
-
-					Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx.
-					A bitwise AND compares the corrseponding bits from two values, and if both bits are 1,
-					then the same bit in the result is also 1. Otherwise, it is 0. 
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					y = ((IR & 0x00F0) >> 4);
-					
-					V[x] &= V[y];
-					
-					//printf("0x8%X%X2 - AND V%X, V%X\n", x, y, x, y);
-					break;
-				case 0x3:
-					/*
-					
-					8xy3 - XOR Vx, Vy
-					Set Vx = Vx XOR Vy.
-
-					Performs a bitwise exclusive OR on the values of Vx and Vy, then stores the result in Vx.
-					An exclusive OR compares the corrseponding bits from two values,
-					and if the bits are not both the same, then the corresponding bit in the result is set to 1.
-					Otherwise, it is 0. 
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					y = ((IR & 0x00F0) >> 4);
-					
-					V[x] ^= V[y];
-					
-					//printf("0x8%X%X3 - XOR V%X, V%X\n", x, y, x, y);
-					break;
-				case 0x4:
-					/*
-					
-					8xy4 - ADD Vx, Vy
-					Set Vx = Vx + Vy, set VF = carry.
-
-					The values of Vx and Vy are added together.
-					If the result is greater than 8 bits (i.e., > 255) VF is set to 1, otherwise 0.
-					Only the lowest 8 bits of the result are kept, and stored in Vx.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					y = ((IR & 0x00F0) >> 4);
-					
-					z = V[x] + V[y];
-					
-					if (V[x] > V[y])
-					{
-						V[0xF] = (V[x] > z) ? 1 : 0;
-					}
-					else
-					{
-						V[0xF] = (V[y] > z) ? 1 : 0;
-					}
-					
-					V[x] = z;
-					
-					//printf("0x8%X%X4 - ADD V%X, V%X\n", x, y, x, y);
-					break;
-				case 0x5:
-					/*
-					
-					8xy5 - SUB Vx, Vy
-					Set Vx = Vx - Vy, set VF = NOT borrow.
-
-					If Vx > Vy, then VF is set to 1, otherwise 0.
-					Then Vy is subtracted from Vx, and the results stored in Vx.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					y = ((IR & 0x00F0) >> 4);
-					
-					V[0xF] = (V[x] > V[y]) ? 1 : 0;
-					
-					V[x] -= V[y];
-					
-					//printf("0x8%X%X5 - SUB V%X, V%X\n", x, y, x, y);
-					break;
-				case 0x6:
-					/*
-					
-					8xy6 - SHR Vx {, Vy}
-					Set Vx = Vx SHR 1.
-
-					If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0.
-					Then Vx is divided by 2.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					y = ((IR & 0x00F0) >> 4);
-					
-					V[0xF] = ((V[x] & 0x01) == 0x1) ? 1 : 0;
-					V[x] >>= 1;
-					
-					//printf("0x8%X%X6 - SHR V%X {, V%X}\n", x, y, x, y);
-					break;
-				case 0x7:
-					/*
-					
-					8xy7 - SUBN Vx, Vy
-					Set Vx = Vy - Vx, set VF = NOT borrow.
-
-					If Vy > Vx, then VF is set to 1, otherwise 0.
-					Then Vx is subtracted from Vy, and the results stored in Vx.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					y = ((IR & 0x00F0) >> 4);
-					
-					V[0xF] = (V[y] > V[x]) ? 1 : 0;
-					
-					V[x] -= V[y];
-					
-					//printf("0x8%X%X7 - SUBN V%X, V%X\n", x, y, x, y);
-					break;
-				case 0xE:
-					/*
-					
-					8xyE - SHL Vx {, Vy}
-					
-					Set Vx = Vx SHL 1.
-
-					If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0.
-					Then Vx is multiplied by 2.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					y = ((IR & 0x00F0) >> 4);
-					
-					V[0xF] = (V[x] & 0x80) ? 1 : 0;
-					
-					V[x] <<= 1;
-					
-					//printf("0x8%X%XE - SHL V%X {, V%X}\n", x, y, x, y);
-					break;
-			}
-			break;
-		case 0x9:
-			/*
-			
-			9xy0 - SNE Vx, Vy
-			Skip next instruction if Vx != Vy.
-
-			The values of Vx and Vy are compared, and if they are not equal,
-			the program counter is increased by 2.
-			
-			*/
-			
-			PC++;
-			
-			x = ((IR & 0x0F00) >> 8);
-			y = ((IR & 0x00F0) >> 4);
-			
-			if (V[x] != V[y])
-			{
-				PC += 2;
-			}
-
-			//printf("0x9%X%X0 - SNE V%X, V%X\n", x, y, x, y);
-			break;
-		case 0xA:
-			/*
-			
-			Annn - LD I, addr
-			Set I = nnn.
-
-			The value of register I is set to nnn.
-			
-			*/
-			
-			PC++;
-			
-			I = (IR & 0x0FFF);	
-
-			//printf("0xA%03X - LD I, 0x%03X\n", I, I);
-			break;
-		case 0xB:
-			/* 
-
-			Bnnn - JP V0, addr
-			Jump to location nnn + V0.
-
-			The program counter is set to nnn plus the value of V0.
-			
-			*/
-			
-			PC = (IR & 0x0FFF) + V[0x0];
-			
-			//printf("0xB%03X - JP V0, 0x%03X\n", PC, PC);
-			break;
-		case 0xC:
-			/*
-			
-			Cxkk - RND Vx, byte
-			Set Vx = random byte AND kk.
-
-			The interpreter generates a random number from 0 to 255,
-			which is then ANDed with the value kk. The results are stored in Vx.
-			See instruction 8xy2 for more information on AND.
-			
-			*/
-			
-			PC++;
-			
-			x = ((IR & 0x0F00) >> 8);
-			kk = (IR & 0x00FF);
-			
-			V[x] = (rand() & kk); // rand() % 256 is redundant
-			
-			//printf("0xC%X%02X - RND V%X, 0x%02X\n", x, kk, x, kk);
-			break;
-		case 0xD:
-			/*
-			
-			Dxyn - DRW Vx, Vy, nibble
-			Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
-
-			The interpreter reads n bytes from memory, starting at the address stored in I.
-			These bytes are then displayed as sprites on screen at coordinates (Vx, Vy).
-			Sprites are XORed onto the existing screen. If this causes any pixels to be erased,
-			VF is set to 1, otherwise it is set to 0.
-			If the sprite is positioned so part of it is outside the coordinates of the display,
-			it wraps around to the opposite side of the screen.
-			See instruction 8xy3 for more information on XOR, and section 2.4, Display,
-			for more information on the Chip-8 screen and sprites.
-			
-			*/
-			
-			PC++;
-
-			x = ((IR & 0x0F00) >> 8);
-			y = ((IR & 0x00F0) >> 4);
-			
-			n = (IR & 0x000F);
-			
-			draw_sprite(x, y, n);
-			
-			SDL_Rect r;
-			
-			r.w = SCALE;
-			r.h = SCALE;	
-			r.y = (V[y]*SCALE);
-			r.x = (V[x]*SCALE);
-			
-			for (yline = 0; (yline < n); yline++)
-				for(xpix = 0; (xpix < 8); xpix++)
-				{SDL_FillRect(scr, &r, (Display[V[x]+xpix][V[y]+xpix] == 1) ? 0xFF : 0x0);}
-			//SDL_FillRect(scr, &r, (Display[V[x]][V[y]] == 1) ? 0xFF : 0x0);
-			SDL_UpdateRect(scr, r.x, r.y, r.w*8, r.h*n);
-			
-			//printf("0xD%X%X%X - DRW V%X, V%X, 0x%X\n", x, y, n, x, y, n);
-			break;
-		case 0xE:
-			switch(IR & 0x00FF)
-			{
-				case 0x9E:
-					/*
-					
-					Ex9E - SKP Vx
-					Skip next instruction if key with the value of Vx is pressed.
-
-					Checks the keyboard,
-					and if the key corresponding to the value of Vx is currently in the down position,
-					PC is increased by 2.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					
-					key_value = keyboard_event(Events);
-					
-					if (key_value == V[x])
-					{
-						PC += 2;
-					}
-					
-					//printf("0xE%X9E - SKP V%X\n", x, x);
-					break;
-				case 0xA1:
-					/*
-					
-					ExA1 - SKNP Vx
-					Skip next instruction if key with the value of Vx is not pressed.
-
-					Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					
-					key_value = keyboard_event(Events);
-					
-					if (key_value != V[x])
-					{
-						PC += 2;
-					}
-					
-					//printf("0xE%XA1 - SKNP V%X\n", x, x);
-					break;			
-			}
-			break;
-		case 0xF:
-			switch(IR & 0x00FF)
-			{
-				case 0x07:
-					/*
-					
-					Fx07 - LD Vx, DT
-					Set Vx = delay timer value.
-
-					The value of DT is placed into Vx.
-					
-					*/
-					
-					PC++;
-					
-					x = (IR & 0x0F00) >> 8;
-					V[x] = DT;
-					
-					//printf("0xF%X07 - LD V%X, DT = 0x%X\n", x, x, DT);
-					break;
-				case 0x0A:
-					/*
-					
-					Fx0A - LD Vx, K
-					Wait for a key press, store the value of the key in Vx.
-
-					All execution stops until a key is pressed, then the value of that key is stored in Vx.
-					
-					*/
-					
-					PC++;
-					
-					x = (IR & 0x0F00) >> 8;
-					
-					key_value = -1;
-					
-					while (key_value == -1)
-					{
-						key_value = keyboard_event(Events);
-					}
-					
-					V[x] = key_value;
-										
-					//printf("0xF%X0A - LD V%X, DT = 0x%X\n", x, x, DT);
-					break;
-				case 0x15:
-					/*
-					
-					Fx15 - LD DT, Vx
-					Set delay timer = Vx.
-
-					DT is set equal to the value of Vx.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					DT = V[x];
-					
-					//printf("0xF%X15 - LD DT = 0x%X, V%X\n", x, DT, x);
-					break;
-				case 0x18:
-					/*
-					
-					Fx18 - LD ST, Vx
-					Set sound timer = Vx.
-
-					ST is set equal to the value of Vx.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					ST = V[x];
-					
-					//printf("0xF%X18 - LD ST = 0x%X, V%X\n", x, ST, x);
-					break;
-				case 0x1E:
-					/*
-					
-					Fx1E - ADD I, Vx
-					Set I = I + Vx.
-
-					The values of I and Vx are added, and the results are stored in I.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					I += V[x];
-					
-					//printf("0xF%X1E - ADD I, V%X\n", x, x);
-					break;
-				case 0x29:
-					/*
- 
-					Fx29 - LD F, Vx
-					Set I = location of sprite for digit Vx.
-
-					The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx.
-					See section 2.4, Display, for more information on the Chip-8 hexadecimal font. 
-
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);					
-					
-					// 5 Bytes representation per number
-					
-					I = (5 * V[x]);
-
-					//printf("0xF%X29 - LD F, V%X\n", x, x);
-					break;
-				case 0x33:
-					/*
-					
-					Fx33 - LD B, Vx
-					Store BCD representation of Vx in memory locations I, I+1, and I+2.
-
-					The interpreter takes the decimal value of Vx,
-					and places the hundreds digit in memory at location in I,
-					the tens digit at location I+1, and the ones digit at location I+2.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					
-					// Revisar porque puede estar mal
-					
-					memory[I] = BIN2BCD(V[x], 3);
-					memory[I+1] = BIN2BCD(V[x], 2);
-					memory[I+2] = BIN2BCD(V[x], 1);
-					
-					//printf("0xF%X33 - LD B, V%X\n", x, x);
-					break;
-				case 0x55:
-					/*
-					
-					Fx55 - LD [I], Vx
-					Store registers V0 through Vx in memory starting at location I.
-
-					The interpreter copies the values of registers V0 through Vx into memory,
-					starting at the address in I.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					for (i = 0; (i <= x); i++)
-					{
-						memory[I++] = V[i];
-					}
-					
-					//printf("0xF%X55 - LD [I], V%X\n", x, x);
-					break;
-				case 0x65:
-					/*
-					
-					Fx65 - LD Vx, [I]
-					Read registers V0 through Vx from memory starting at location I.
-
-					The interpreter reads values from memory starting at location I into registers V0 through Vx.
-					
-					*/
-					
-					PC++;
-					
-					x = ((IR & 0x0F00) >> 8);
-					for(i = 0; (i <= x); i++)
-					{
-						V[i] = memory[I++];
-					}
-					
-					//printf("0xF%X65 - LD I, V[%X]\n", x, x);
-					break;
-			}
-			break;
-		default:
-			printf("Unknown OPCODE.\n");
-			printf("0x%03x - ??\n", IR);
-			exit(1);
-			break;
-	}		
-}
-
-u16 BIN2BCD (u8 a, short b)
-{
-	switch(b)
-	{
-		case 1:
-			return a%10;
-			break;
-		case 2:
-			return (a%100)/10;
-			break;
-		case 3:
-			return a/100;
-			break;
-		default:
-			return 0;
-			break;
-	}
-	return 0;
-}
-
-void draw_sprite(u8 x, u8 y, u8 n)
-{
-	// Draw to Display
-	
-	u16 xpixel, yline;
-	u8 data;
-	
-	V[0xF] = 0;
-	
-	for(yline = 0; (yline < n); yline++)
-	{
-		data = memory[I + yline];
-		for(xpixel = 0; (xpixel < 8); xpixel++)
-		{
-			if((data & (0x80 >> xpixel)) != 0)
-			{
-				if (Display[V[x] + xpixel][V[y] + yline] == 1)
-				{
-					V[0xF] = 1;
-				}
-				Display[V[x] + xpixel][V[y] + yline] ^= 1;
-			}
-		}
-	}
-}
-
-char keyboard_event(SDL_Event* keyboard)
-{
-/*
-
-KEYBOARD CHIP-8
-
-_________
-|1|2|3|C|
----------
-|4|5|6|D|
----------
-|7|8|9|E|
----------
-|A|0|B|F|
----------
-
-*/
-	while (SDL_PollEvent(keyboard))
-	{
-		switch (keyboard -> type)
-		{
-			case SDL_KEYDOWN:
-				switch (keyboard -> key.keysym.sym)
-				{
-					case SDLK_1: // 1
-						//getchar();
-						return 0x1;
-						break;
-					case SDLK_2: // 2
-						//getchar();
-						return 0x2;
-						break;
-					case SDLK_3: // 3
-						//getchar();
-						return 0x3;
-						break;
-					case SDLK_4: // C
-						//getchar();
-						return 0xC;
-						break;
-					case SDLK_q: // 4
-						//getchar();
-						return 0x4;
-						break;
-					case SDLK_w: // 5
-						//getchar();
-						return 0x5;
-						break;
-					case SDLK_e: // 6
-						//getchar();
-						return 0x6;
-						break;
-					case SDLK_r: // D
-						//getchar();
-						return 0xD;
-						break;
-					case SDLK_a: // 7
-						//getchar();
-						return 0x7;
-						break;
-					case SDLK_s: // 8
-						//getchar();
-						return 0x8;
-						break;
-					case SDLK_d: // 9
-						//getchar();
-						return 0x9;
-						break;
-					case SDLK_f: // E
-						//getchar();
-						return 0xE;
-						break;
-					case SDLK_z: // A
-						//getchar();
-						return 0xA;
-						break;
-					case SDLK_x: // 0
-						//getchar();
-						return 0x0;
-						break;
-					case SDLK_c: // B
-						//getchar();
-						return 0xB;
-						break;
-					case SDLK_v: // F
-						//getchar();
-						return 0xF;
-						break;
-					default:
-						return -1;
-				}
-				break;
-		}
-	}
-	return -1;
-}
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "machine.h"
+
+#include "ops.h"
+#include "profile.h"
+#include "trace.h"
+#include "fork.h"
+#include <sys/stat.h>
+
+static ALWAYS_INLINE void execute (Machine *m, const u8 quirks);
+
+void machine_init (Machine *m)
+{
+	memset(m, 0, sizeof(*m));
+	m->PC = 0x200;
+	m->SP = 0;
+	m->DT = 0;
+	m->ST = 0;
+	m->ipf = CLOCK;
+	m->engine = ENGINE_SWITCH;
+	machine_seed(m, 1);
+	machine_flush(m);
+}
+
+void machine_flush (Machine *m)
+{
+	// Forget every decoded instruction, memory was changed behind our back
+	
+	u16 i;
+	
+	for (i = 0; i < 2048; i++)
+	{
+		m->code[i].op = OP_DECODE;
+		m->code[i].target = 0;
+	}
+	if (m->jit != NULL)
+	{
+		jit_flush(m);
+	}
+	
+	// Nor does it match the pages shared with forks any more
+	m->written = 0xFFFF;
+}
+
+void machine_seed (Machine *m, u32 seed)
+{
+	// The same seed gives the same numbers, 0 would give only zeros
+	
+	m->rng = (seed != 0) ? seed : 0x9E3779B9;
+}
+
+void machine_free (Machine *m)
+{
+	jit_free(m);
+	fork_release(m);
+}
+
+void machine_step (Machine *m)
+{
+#ifdef PROFILE
+	u16 address = m->PC & 0xFFF;
+	u64 start = profile_clock();
+#endif
+	if (m->trace != NULL)
+	{
+		// The same, leaving a record of it
+		trace_step(m);
+	}
+	else
+	{
+		// fetch
+		m->IR = m->memory[m->PC++ & 0xFFF];
+		m->IR = ((m->IR << 8) | m->memory[m->PC & 0xFFF]);
+		// Decode and execution
+		instruction_execute (m);
+	}
+#ifdef PROFILE
+	profile_count(address, m->IR, profile_clock() - start);
+#endif
+}
+
+static ALWAYS_INLINE void cache_execute (Machine *m, Instr *in, u16 address, const u8 quirks)
+{
+	// Run an already decoded instruction, decoding it first if needed
+	
+	if (in->op == OP_DECODE)
+	{
+		instr_decode(in, (m->memory[address] << 8) | m->memory[address + 1]);
+	}
+	
+	switch (in->op)
+	{
+		case OP_CLS:
+			op_cls(m, in);
+			break;
+		case OP_RET:
+			op_ret(m, in);
+			break;
+		case OP_SYS:
+			op_sys(m, in);
+			break;
+		case OP_JP:
+			op_jp(m, in);
+			break;
+		case OP_CALL:
+			op_call(m, in);
+			break;
+		case OP_SE_BYTE:
+			op_se_byte(m, in);
+			break;
+		case OP_SNE_BYTE:
+			op_sne_byte(m, in);
+			break;
+		case OP_SE_REG:
+			op_se_reg(m, in);
+			break;
+		case OP_LD_BYTE:
+			op_ld_byte(m, in);
+			break;
+		case OP_ADD_BYTE:
+			op_add_byte(m, in);
+			break;
+		case OP_LD_REG:
+			op_ld_reg(m, in);
+			break;
+		case OP_OR:
+			op_or(m, in);
+			break;
+		case OP_AND:
+			op_and(m, in);
+			break;
+		case OP_XOR:
+			op_xor(m, in);
+			break;
+		case OP_ADD_REG:
+			op_add_reg(m, in);
+			break;
+		case OP_SUB:
+			op_sub(m, in);
+			break;
+		case OP_SHR:
+			op_shr(m, in, quirks);
+			break;
+		case OP_SUBN:
+			op_subn(m, in);
+			break;
+		case OP_SHL:
+			op_shl(m, in, quirks);
+			break;
+		case OP_SNE_REG:
+			op_sne_reg(m, in);
+			break;
+		case OP_LD_I:
+			op_ld_i(m, in);
+			break;
+		case OP_JP_V0:
+			op_jp_v0(m, in, quirks);
+			break;
+		case OP_RND:
+			op_rnd(m, in);
+			break;
+		case OP_DRW:
+			op_drw(m, in);
+			break;
+		case OP_SKP:
+			op_skp(m, in);
+			break;
+		case OP_SKNP:
+			op_sknp(m, in);
+			break;
+		case OP_LD_VX_DT:
+			op_ld_vx_dt(m, in);
+			break;
+		case OP_LD_KEY:
+			op_ld_key(m, in);
+			break;
+		case OP_LD_DT:
+			op_ld_dt(m, in);
+			break;
+		case OP_LD_ST:
+			op_ld_st(m, in);
+			break;
+		case OP_ADD_I:
+			op_add_i(m, in);
+			break;
+		case OP_LD_F:
+			op_ld_f(m, in);
+			break;
+		case OP_LD_B:
+			op_ld_b(m, in);
+			break;
+		case OP_LD_MEM:
+			op_ld_mem(m, in, quirks);
+			break;
+		case OP_LD_REG_MEM:
+			op_ld_reg_mem(m, in, quirks);
+			break;
+		case OP_SCD:
+			op_scd(m, in);
+			break;
+		case OP_SCR:
+			op_scr(m, in);
+			break;
+		case OP_SCL:
+			op_scl(m, in);
+			break;
+		case OP_EXIT:
+			op_exit(m, in);
+			break;
+		case OP_LOW:
+			op_low(m, in);
+			break;
+		case OP_HIGH:
+			op_high(m, in);
+			break;
+		case OP_LD_HF:
+			op_ld_hf(m, in);
+			break;
+		case OP_LD_R:
+			op_ld_r(m, in);
+			break;
+		case OP_LD_VX_R:
+			op_ld_vx_r(m, in);
+			break;
+		case OP_NONE:
+			op_none(m, in);
+			break;
+	}
+}
+
+/*
+
+The switch and cache engines, built once for every set of quirks that
+change ops, see QUIRK_EACH in ops.h. Tracing and profiling the switch
+engine go through machine_step instead, which asks for the quirks every
+instruction.
+
+*/
+
+static ALWAYS_INLINE void switch_core (Machine *m, unsigned int left, const u8 quirks)
+{
+	while (left > 0)
+	{
+		m->IR = m->memory[m->PC++ & 0xFFF];
+		m->IR = ((m->IR << 8) | m->memory[m->PC & 0xFFF]);
+		execute(m, quirks);
+		left--;
+	}
+}
+
+static ALWAYS_INLINE void cache_core (Machine *m, unsigned int left, const u8 quirks)
+{
+	Instr *in;
+	
+	while (left > 0)
+	{
+		if (m->PC & 1)
+		{
+			// Odd addresses are never cached
+			machine_step(m);
+		}
+		else
+		{
+			// Decoded once, no fetch and no decode here
+			in = &m->code[(m->PC & 0xFFF) >> 1];
+			cache_execute(m, in, m->PC++ & 0xFFF, quirks);
+			m->IR = in->ir;
+		}
+		left--;
+	}
+}
+
+#define CACHE_RUN(q) static void cache_run_##q (Machine *m, unsigned int left) { cache_core(m, left, q); }
+
+QUIRK_EACH(CACHE_RUN)
+
+static void (* const cache_runs[QUIRK_SETS]) (Machine *m, unsigned int left) = QUIRK_TABLE(cache_run);
+
+// A profiling build times every instruction in machine_step instead
+
+#ifndef PROFILE
+#define SWITCH_RUN(q) static void switch_run_##q (Machine *m, unsigned int left) { switch_core(m, left, q); }
+
+QUIRK_EACH(SWITCH_RUN)
+
+static void (* const switch_runs[QUIRK_SETS]) (Machine *m, unsigned int left) = QUIRK_TABLE(switch_run);
+#endif
+
+/*
+
+Idle loops
+
+	L:	Fx07	LD Vx, DT
+		3xkk	SE Vx, kk
+		1L	JP L
+
+waits for the delay timer, which only changes between frames. While DT is
+not kk the rest of the frame only moves PC around the three instructions
+and leaves DT in Vx, so that is worked out at once instead of running it.
+machine_run checks at the start of every frame, the jit engine also when
+a block starts one. Returns 1 when the left instructions were done.
+Build with -DNO_IDLE_LOOPS to always run them.
+
+*/
+
+int machine_idle (Machine *m, unsigned int left)
+{
+	u16 L, ir[3];
+	u8 q, x, kk, first;
+	
+	for (q = 0; q < 3; q++)
+	{
+		L = m->PC - 2 * q;
+		if (L > m->PC || L + 5 > 0xFFF)
+		{
+			continue;
+		}
+		ir[0] = m->memory[L] << 8 | m->memory[L + 1];
+		ir[1] = m->memory[L + 2] << 8 | m->memory[L + 3];
+		ir[2] = m->memory[L + 4] << 8 | m->memory[L + 5];
+		x = (ir[0] >> 8) & 0xF;
+		kk = ir[1] & 0xFF;
+		if ((ir[0] & 0xF0FF) == 0xF007 && (ir[1] & 0xFF00) == (0x3000 | x << 8) && ir[2] == (0x1000 | L))
+		{
+			break;
+		}
+	}
+	
+	// Leaves the loop in this frame, or it is not one
+	if (q == 3 || (m->DT & 0xFF) == kk || (q == 1 && m->V[x] == kk) || left == 0)
+	{
+		return 0;
+	}
+	
+	// The first Fx07 comes after the rest of the turn around the loop
+	first = (3 - q) % 3;
+	if (left > first)
+	{
+		m->V[x] = m->DT;
+	}
+	q = (q + left) % 3;
+	m->PC = L + 2 * q;
+	m->IR = ir[(q + 2) % 3];
+	return 1;
+}
+
+void machine_run (Machine *m)
+{
+	// Run until the next tick of the timers
+	
+	unsigned int left = m->ipf;
+	
+	if (m->waiting && m->keys == 0)
+	{
+		// Nothing to run until a key is down
+		left = 0;
+	}
+#ifndef NO_IDLE_LOOPS
+	else if (machine_idle(m, left))
+	{
+		left = 0;
+	}
+#endif
+	if (m->engine == ENGINE_CACHE)
+	{
+		cache_runs[m->quirks & QUIRK_OPS](m, left);
+	}
+	else if (m->engine == ENGINE_THREADED)
+	{
+		threaded_run(m, left);
+	}
+	else if (m->engine == ENGINE_JIT)
+	{
+		jit_run(m, left);
+	}
+	else if (m->engine == ENGINE_AOT)
+	{
+		aot_run(m, left);
+	}
+#ifndef PROFILE
+	else if (m->trace == NULL)
+	{
+		switch_runs[m->quirks & QUIRK_OPS](m, left);
+	}
+#endif
+	else
+	{
+		while (left > 0)
+		{
+			machine_step(m);
+			left--;
+		}
+	}
+	
+	// Timers stop at 0
+	if (m->DT > 0)
+	{
+		m->DT--;
+	}
+	if (m->ST > 0)
+	{
+		m->ST--;
+	}
+	m->frame++;
+}
+
+void machine_skip (Machine *m, unsigned long frames)
+{
+	// Let frames go by while waiting for a key, the same as running them
+	
+	m->DT = (m->DT > frames) ? m->DT - frames : 0;
+	m->ST = (m->ST > frames) ? m->ST - frames : 0;
+	m->frame += frames;
+}
+
+void instruction_execute (Machine *m)
+{
+	// One instruction with the machine's quirks, for whoever runs them one at a time
+	
+	execute(m, m->quirks & QUIRK_OPS);
+}
+
+static ALWAYS_INLINE void execute (Machine *m, const u8 quirks)
+{
+	Instr in;
+	
+	in.ir = m->IR;
+	in.nnn = (m->IR & 0x0FFF);
+	in.x = ((m->IR & 0x0F00) >> 8);
+	in.y = ((m->IR & 0x00F0) >> 4);
+	in.kk = (m->IR & 0x00FF);
+	in.n = (m->IR & 0x000F);
+	
+	switch (m->IR >> 12)
+	{
+		case 0x0:
+			if (m->IR == 0x00E0)
+			{
+				op_cls(m, &in);
+			}
+			else if (m->IR == 0x00EE)
+			{
+				op_ret(m, &in);
+			}
+			else if ((m->IR & 0xFFF0) == 0x00C0)
+			{
+				op_scd(m, &in);
+			}
+			else if (m->IR == 0x00FB)
+			{
+				op_scr(m, &in);
+			}
+			else if (m->IR == 0x00FC)
+			{
+				op_scl(m, &in);
+			}
+			else if (m->IR == 0x00FD)
+			{
+				op_exit(m, &in);
+			}
+			else if (m->IR == 0x00FE)
+			{
+				op_low(m, &in);
+			}
+			else if (m->IR == 0x00FF)
+			{
+				op_high(m, &in);
+			}
+			else
+			{
+				op_sys(m, &in);
+			}
+			break;
+		case 0x1:
+			op_jp(m, &in);
+			break;
+		case 0x2:
+			op_call(m, &in);
+			break;
+		case 0x3:
+			op_se_byte(m, &in);
+			break;
+		case 0x4:
+			op_sne_byte(m, &in);
+			break;
+		case 0x5:
+			op_se_reg(m, &in);
+			break;
+		case 0x6:
+			op_ld_byte(m, &in);
+			break;
+		case 0x7:
+			op_add_byte(m, &in);
+			break;
+		case 0x8:
+			switch (m->IR & 0x000F)
+			{
+				case 0x0:
+					op_ld_reg(m, &in);
+					break;
+				case 0x1:
+					op_or(m, &in);
+					break;
+				case 0x2:
+					op_and(m, &in);
+					break;
+				case 0x3:
+					op_xor(m, &in);
+					break;
+				case 0x4:
+					op_add_reg(m, &in);
+					break;
+				case 0x5:
+					op_sub(m, &in);
+					break;
+				case 0x6:
+					op_shr(m, &in, quirks);
+					break;
+				case 0x7:
+					op_subn(m, &in);
+					break;
+				case 0xE:
+					op_shl(m, &in, quirks);
+					break;
+			}
+			break;
+		case 0x9:
+			op_sne_reg(m, &in);
+			break;
+		case 0xA:
+			op_ld_i(m, &in);
+			break;
+		case 0xB:
+			op_jp_v0(m, &in, quirks);
+			break;
+		case 0xC:
+			op_rnd(m, &in);
+			break;
+		case 0xD:
+			op_drw(m, &in);
+			break;
+		case 0xE:
+			switch(m->IR & 0x00FF)
+			{
+				case 0x9E:
+					op_skp(m, &in);
+					break;
+				case 0xA1:
+					op_sknp(m, &in);
+					break;
+			}
+			break;
+		case 0xF:
+			switch(m->IR & 0x00FF)
+			{
+				case 0x07:
+					op_ld_vx_dt(m, &in);
+					break;
+				case 0x0A:
+					op_ld_key(m, &in);
+					break;
+				case 0x15:
+					op_ld_dt(m, &in);
+					break;
+				case 0x18:
+					op_ld_st(m, &in);
+					break;
+				case 0x1E:
+					op_add_i(m, &in);
+					break;
+				case 0x29:
+					op_ld_f(m, &in);
+					break;
+				case 0x30:
+					op_ld_hf(m, &in);
+					break;
+				case 0x33:
+					op_ld_b(m, &in);
+					break;
+				case 0x55:
+					op_ld_mem(m, &in, quirks);
+					break;
+				case 0x65:
+					op_ld_reg_mem(m, &in, quirks);
+					break;
+				case 0x75:
+					op_ld_r(m, &in);
+					break;
+				case 0x85:
+					op_ld_vx_r(m, &in);
+					break;
+			}
+			break;
+	}		
+}
+
+void instr_decode (Instr *in, u16 ir)
+{
+	// Same choices as instruction_execute, remembered instead of taken
+	
+	in->ir = ir;
+	in->nnn = (ir & 0x0FFF);
+	in->x = ((ir & 0x0F00) >> 8);
+	in->y = ((ir & 0x00F0) >> 4);
+	in->kk = (ir & 0x00FF);
+	in->n = (ir & 0x000F);
+	in->op = OP_NONE;
+	
+	switch (ir >> 12)
+	{
+		case 0x0:
+			if (ir == 0x00E0)
+			{
+				in->op = OP_CLS;
+			}
+			else if (ir == 0x00EE)
+			{
+				in->op = OP_RET;
+			}
+			else if ((ir & 0xFFF0) == 0x00C0)
+			{
+				in->op = OP_SCD;
+			}
+			else if (ir == 0x00FB)
+			{
+				in->op = OP_SCR;
+			}
+			else if (ir == 0x00FC)
+			{
+				in->op = OP_SCL;
+			}
+			else if (ir == 0x00FD)
+			{
+				in->op = OP_EXIT;
+			}
+			else if (ir == 0x00FE)
+			{
+				in->op = OP_LOW;
+			}
+			else if (ir == 0x00FF)
+			{
+				in->op = OP_HIGH;
+			}
+			else
+			{
+				in->op = OP_SYS;
+			}
+			break;
+		case 0x1:
+			in->op = OP_JP;
+			break;
+		case 0x2:
+			in->op = OP_CALL;
+			break;
+		case 0x3:
+			in->op = OP_SE_BYTE;
+			break;
+		case 0x4:
+			in->op = OP_SNE_BYTE;
+			break;
+		case 0x5:
+			in->op = OP_SE_REG;
+			break;
+		case 0x6:
+			in->op = OP_LD_BYTE;
+			break;
+		case 0x7:
+			in->op = OP_ADD_BYTE;
+			break;
+		case 0x8:
+			switch (ir & 0x000F)
+			{
+				case 0x0:
+					in->op = OP_LD_REG;
+					break;
+				case 0x1:
+					in->op = OP_OR;
+					break;
+				case 0x2:
+					in->op = OP_AND;
+					break;
+				case 0x3:
+					in->op = OP_XOR;
+					break;
+				case 0x4:
+					in->op = OP_ADD_REG;
+					break;
+				case 0x5:
+					in->op = OP_SUB;
+					break;
+				case 0x6:
+					in->op = OP_SHR;
+					break;
+				case 0x7:
+					in->op = OP_SUBN;
+					break;
+				case 0xE:
+					in->op = OP_SHL;
+					break;
+			}
+			break;
+		case 0x9:
+			in->op = OP_SNE_REG;
+			break;
+		case 0xA:
+			in->op = OP_LD_I;
+			break;
+		case 0xB:
+			in->op = OP_JP_V0;
+			break;
+		case 0xC:
+			in->op = OP_RND;
+			break;
+		case 0xD:
+			in->op = OP_DRW;
+			break;
+		case 0xE:
+			switch(ir & 0x00FF)
+			{
+				case 0x9E:
+					in->op = OP_SKP;
+					break;
+				case 0xA1:
+					in->op = OP_SKNP;
+					break;
+			}
+			break;
+		case 0xF:
+			switch(ir & 0x00FF)
+			{
+				case 0x07:
+					in->op = OP_LD_VX_DT;
+					break;
+				case 0x0A:
+					in->op = OP_LD_KEY;
+					break;
+				case 0x15:
+					in->op = OP_LD_DT;
+					break;
+				case 0x18:
+					in->op = OP_LD_ST;
+					break;
+				case 0x1E:
+					in->op = OP_ADD_I;
+					break;
+				case 0x29:
+					in->op = OP_LD_F;
+					break;
+				case 0x30:
+					in->op = OP_LD_HF;
+					break;
+				case 0x33:
+					in->op = OP_LD_B;
+					break;
+				case 0x55:
+					in->op = OP_LD_MEM;
+					break;
+				case 0x65:
+					in->op = OP_LD_REG_MEM;
+					break;
+				case 0x75:
+					in->op = OP_LD_R;
+					break;
+				case 0x85:
+					in->op = OP_LD_VX_R;
+					break;
+			}
+			break;
+	}
+}
+
+/*
+
+Sprites of the SUPER-CHIP, 16 x 16 ones from Dxy0 and any in 128 x 64.
+A line of the screen is taken as one 128 bit number, its two words put
+together, and the sprite line is shifted into place and XORed over it.
+In low resolution the screen is the top 64 bits of it, the rest stays 0.
+
+*/
+
+typedef unsigned __int128 u128;
+
+static void draw_wide (Machine *m, u8 x, u8 y, u8 n)
+{
+	u16 yline, py, a;
+	u8 px, cols = COLUMNS(m), lines = LINES(m), width = (n == 0) ? 16 : 8;
+	u128 line, screen, hit = 0;
+	
+	// All ones when wrapping, nothing when clipping, and the columns there are
+	u128 wrap = (u128) 0 - !(m->quirks & QUIRK_CLIP);
+	u128 inside = ~(u128) 0 << (X_HIRES - cols);
+	
+	n = (n == 0) ? 16 : n;
+	px = m->V[x] % cols;
+	py = m->V[y] % lines;
+	for (yline = 0; yline < n; yline++, py++)
+	{
+		if (width == 16)
+		{
+			a = m->I + 2 * yline;
+			line = (u128) (m->memory[a & 0xFFF] << 8 | m->memory[(a + 1) & 0xFFF]) << (X_HIRES - 16);
+		}
+		else
+		{
+			line = (u128) m->memory[(m->I + yline) & 0xFFF] << (X_HIRES - 8);
+		}
+		line = ((line >> px) | ((line << ((cols - px) % cols)) & wrap)) & inside;
+		line &= wrap | ((u128) 0 - (py < lines));
+		screen = (u128) m->Display[py % lines][0] << 64 | m->Display[py % lines][1];
+		hit |= screen & line;
+		screen ^= line;
+		m->Display[py % lines][0] = screen >> 64;
+		m->Display[py % lines][1] = (u64) screen;
+		m->dirty |= (u64) (line != 0) << (py % lines);
+	}
+	m->V[0xF] = (hit != 0);
+}
+
+void draw_sprite(Machine *m, u8 x, u8 y, u8 n)
+{
+	// Draw to Display, a whole sprite line with one XOR
+	
+	u16 yline, py;
+	u8 px;
+	u64 line, hit = 0;
+	
+	// All ones when wrapping, nothing when clipping
+	u64 wrap = (u64) 0 - !(m->quirks & QUIRK_CLIP);
+	
+	if (m->hires || n == 0)
+	{
+		draw_wide(m, x, y, n);
+		return;
+	}
+	
+	// The start is always on screen, what goes past the edge wraps or is cut
+	px = m->V[x] % X_MAX;
+	py = m->V[y] % Y_MAX;
+	for(yline = 0; (yline < n); yline++, py++)
+	{
+		line = (u64) m->memory[(m->I + yline) & 0xFFF] << (X_MAX - 8);
+		line = (line >> px) | ((line << ((X_MAX - px) % X_MAX)) & wrap);
+		line &= wrap | ((u64) 0 - (py < Y_MAX));
+		hit |= m->Display[py % Y_MAX][0] & line;
+		m->Display[py % Y_MAX][0] ^= line;
+		m->dirty |= (u64) (line != 0) << (py % Y_MAX);
+	}
+	m->V[0xF] = (hit != 0);
+}
+
+void scroll_down (Machine *m, u8 n)
+{
+	// Whole lines move, two words each, blank ones come in at the top
+	
+	u8 lines = LINES(m);
+	
+	memmove(m->Display[n], m->Display[0], (lines - n) * sizeof(m->Display[0]));
+	memset(m->Display[0], 0, n * sizeof(m->Display[0]));
+	m->dirty = ALL_LINES(m);
+}
+
+void scroll_side (Machine *m, int by)
+{
+	// Right when by is positive, left when not, the two words of a line shifted together
+	
+	u8 y, lines = LINES(m);
+	u64 *w;
+	
+	// In low resolution nothing goes into the second word
+	u64 keep = (u64) 0 - m->hires;
+	
+	for (y = 0; y < lines; y++)
+	{
+		w = m->Display[y];
+		if (by > 0)
+		{
+			w[1] = ((w[1] >> by) | (w[0] << (64 - by))) & keep;
+			w[0] >>= by;
+		}
+		else
+		{
+			w[0] = (w[0] << -by) | (w[1] >> (64 + by));
+			w[1] <<= -by;
+		}
+	}
+	m->dirty = ALL_LINES(m);
+}
+
+void screen_mode (Machine *m, u8 hires)
+{
+	// The screen starts blank in its new size
+	
+	m->hires = hires;
+	memset(m->Display, 0, sizeof(m->Display));
+	m->dirty = ALL_LINES(m);
+}
+
+unsigned long rom_hash (u8 *data, int size)
+{
+	// FNV-1a, good enough to tell ROMs apart
+	
+	unsigned long hash = 0x811C9DC5;
+	int i;
+	
+	for (i = 0; i < size; i++)
+	{
+		hash = ((hash ^ data[i]) * 0x01000193) & 0xFFFFFFFF;
+	}
+	return hash;
+}
+
+/*
+
+Quirks
+
+The ROMs that need some, by hash of their contents, everything else runs
+without any. Then the names quirks_parse knows, one quirk or a whole set
+of them as some interpreter had it.
+
+*/
+
+typedef struct Quirks
+{
+	unsigned long rom;
+	u8 quirks;
+} Quirks;
+
+static const Quirks rom_table[] =
+{
+	{0x49E5336B, QUIRK_CLIP}	// BLITZ
+};
+
+typedef struct QuirkName
+{
+	const char *name;
+	u8 quirks;
+} QuirkName;
+
+static const QuirkName quirk_names[] =
+{
+	{"none", 0},
+	{"shift-vy", QUIRK_SHIFT_VY},
+	{"keep-i", QUIRK_KEEP_I},
+	{"jump-vx", QUIRK_JUMP_VX},
+	{"clip", QUIRK_CLIP},
+	{"vip", QUIRK_SHIFT_VY | QUIRK_CLIP},
+	{"schip", QUIRK_KEEP_I | QUIRK_JUMP_VX | QUIRK_CLIP}
+};
+
+u8 rom_quirks (unsigned long rom)
+{
+	unsigned int i;
+	
+	for (i = 0; i < sizeof(rom_table) / sizeof(rom_table[0]); i++)
+	{
+		if (rom == rom_table[i].rom)
+		{
+			return rom_table[i].quirks;
+		}
+	}
+	return 0;
+}
+
+int quirks_parse (char *list, u8 *quirks)
+{
+	// Names separated by commas, all of them together, 0 for a name not known
+	
+	char *name, *end;
+	size_t length;
+	unsigned int i;
+	u8 got = 0;
+	
+	for (name = list; ; name = end + 1)
+	{
+		end = strchr(name, ',');
+		length = (end != NULL) ? (size_t) (end - name) : strlen(name);
+		for (i = 0; i < sizeof(quirk_names) / sizeof(quirk_names[0]); i++)
+		{
+			if (strlen(quirk_names[i].name) == length && strncmp(name, quirk_names[i].name, length) == 0)
+			{
+				break;
+			}
+		}
+		if (i == sizeof(quirk_names) / sizeof(quirk_names[0]))
+		{
+			return 0;
+		}
+		got |= quirk_names[i].quirks;
+		if (end == NULL)
+		{
+			break;
+		}
+	}
+	*quirks = got;
+	return 1;
+}
+
+/*
+
+ROM images
+
+Every file is read once, with a single fread, and kept for as long as the
+process runs, so starting many machines with the same game costs a stat
+and a memcpy. A name is found with the size of its file and the time of
+its last change, to the nanosecond where the system keeps it, so a file
+written again is read again and what it had before is let go once no name
+has it. Contents are kept once, found by hash, so names with the same bytes
+share them and only new contents count against IMAGE_MAX. Past that, what
+is not kept yet is read each time.
+
+A spin lock is held to look up and copy out, and to change the lists, so
+no bytes are freed while another thread copies them. Files are read with
+it let go.
+
+*/
+
+#define IMAGE_MAX 64
+
+// Nanoseconds of the time of the last change, where there are any
+
+#if defined(__APPLE__)
+#define CHANGED_NS(st) ((st).st_mtimespec.tv_nsec)
+#elif defined(_WIN32)
+#define CHANGED_NS(st) 0
+#else
+#define CHANGED_NS(st) ((st).st_mtim.tv_nsec)
+#endif
+
+typedef struct Image
+{
+	struct Image *next;
+	unsigned long hash;
+	
+	// Names with these contents
+	int refs;
+	
+	// Bytes in the file, ROM_MAX + 1 when there are more than fit
+	int size;
+	u8 bytes[];
+} Image;
+
+typedef struct ImageName
+{
+	struct ImageName *next;
+	char *name;
+	Image *image;
+	
+	// Of the file when it was read
+	off_t file_size;
+	time_t changed;
+	long changed_ns;
+} ImageName;
+
+static Image *images;
+static ImageName *image_names;
+static int kept;
+static int image_lock;
+
+static void image_take_lock (void)
+{
+	while (__atomic_exchange_n(&image_lock, 1, __ATOMIC_ACQUIRE))
+	{
+	}
+}
+
+static void image_let_lock (void)
+{
+	__atomic_store_n(&image_lock, 0, __ATOMIC_RELEASE);
+}
+
+static void image_drop (Image *image)
+{
+	// One name less, the last one frees it
+	
+	Image **at;
+	
+	if (--image->refs > 0)
+	{
+		return;
+	}
+	for (at = &images; *at != image; at = &(*at)->next)
+	{
+	}
+	*at = image->next;
+	free(image);
+	kept--;
+}
+
+static void image_keep (const char *name, struct stat *st, const u8 *bytes, int size, unsigned long hash)
+{
+	// name now has bytes, with the lock held
+	
+	ImageName *n, **at;
+	Image *image;
+	
+	for (at = &image_names; *at != NULL && strcmp((*at)->name, name) != 0; at = &(*at)->next)
+	{
+	}
+	n = *at;
+	for (image = images; image != NULL; image = image->next)
+	{
+		if (image->hash == hash && image->size == size && memcmp(image->bytes, bytes, size) == 0)
+		{
+			break;
+		}
+	}
+	if (image == NULL && kept < IMAGE_MAX)
+	{
+		image = malloc(sizeof(Image) + size);
+		if (image != NULL)
+		{
+			image->hash = hash;
+			image->refs = 0;
+			image->size = size;
+			memcpy(image->bytes, bytes, size);
+			image->next = images;
+			images = image;
+			kept++;
+		}
+	}
+	if (n == NULL && image != NULL)
+	{
+		n = malloc(sizeof(ImageName));
+		if (n != NULL)
+		{
+			n->name = malloc(strlen(name) + 1);
+		}
+		if (n == NULL || n->name == NULL)
+		{
+			free(n);
+			image->refs++;
+			image_drop(image);
+			return;
+		}
+		strcpy(n->name, name);
+		n->image = NULL;
+		n->next = NULL;
+		*at = n;
+	}
+	if (n == NULL)
+	{
+		return;
+	}
+	
+	// What the file had before goes, and the name with it when the new one is not kept
+	if (image != NULL)
+	{
+		image->refs++;
+	}
+	if (n->image != NULL)
+	{
+		image_drop(n->image);
+	}
+	if (image == NULL)
+	{
+		*at = n->next;
+		free(n->name);
+		free(n);
+		return;
+	}
+	n->image = image;
+	n->file_size = st->st_size;
+	n->changed = st->st_mtime;
+	n->changed_ns = CHANGED_NS(*st);
+}
+
+static int image_read (const char *name, u8 *to, int room, unsigned long *hash)
+{
+	// Bytes in the file, ROM_MAX + 1 when there are more, copied to to when they fit in room, -1 when it can not be read
+	
+	u8 buffer[ROM_MAX + 1];
+	ImageName *n;
+	struct stat st;
+	FILE *file;
+	int size;
+	
+	if (stat(name, &st) != 0)
+	{
+		return -1;
+	}
+	image_take_lock();
+	for (n = image_names; n != NULL; n = n->next)
+	{
+		if (strcmp(n->name, name) == 0 && n->file_size == st.st_size && n->changed == st.st_mtime && n->changed_ns == CHANGED_NS(st))
+		{
+			size = n->image->size;
+			*hash = n->image->hash;
+			if (size <= room)
+			{
+				memcpy(to, n->image->bytes, size);
+			}
+			image_let_lock();
+			return size;
+		}
+	}
+	image_let_lock();
+	
+	file = fopen(name, "rb");
+	if (file == NULL)
+	{
+		return -1;
+	}
+	
+	// One more than fits, to know it is too big
+	size = fread(buffer, 1, ROM_MAX + 1, file);
+	fclose(file);
+	*hash = rom_hash(buffer, size);
+	if (size <= room)
+	{
+		memcpy(to, buffer, size);
+	}
+	
+	image_take_lock();
+	image_keep(name, &st, buffer, size, *hash);
+	image_let_lock();
+	return size;
+}
+
+int read_rom(Machine *m)
+{
+	// Fonts from CHIP8.ROM, at the start of memory and up to 0x200
+	
+	unsigned long hash;
+	int size = image_read("CHIP8.ROM", m->memory, 0x200, &hash);
+	
+	if (size < 0)
+	{
+		return LOAD_MISSING;
+	}
+	if (size > 0x200)
+	{
+		return LOAD_TOO_BIG;
+	}
+	machine_flush(m);
+	return LOAD_OK;
+}
+
+void load_rom(Machine *m)
+{
+	int got = read_rom(m);
+	
+	if (got == LOAD_MISSING)
+	{
+		printf("Error, no encontrado \"CHIP8.ROM\"n.");
+		exit(1);
+	}
+	if (got == LOAD_TOO_BIG)
+	{
+		printf("Error, CHIP8.ROM is bigger than %d bytes.\n", 0x200);
+		exit(1);
+	}
+}
+
+int read_game(Machine *m, char *game_name)
+{
+	// Same as load_game without a word
+	
+	unsigned long hash;
+	int size = image_read(game_name, &m->memory[0x200], ROM_MAX, &hash);
+	
+	if (size < 0)
+	{
+		return LOAD_MISSING;
+	}
+	if (size > ROM_MAX)
+	{
+		return LOAD_TOO_BIG;
+	}
+	m->rom = hash;
+	m->quirks = rom_quirks(m->rom);
+	machine_flush(m);
+	return LOAD_OK;
+}
+
+void load_game(Machine *m, char *game_name)
+{
+	int got;
+	
+	printf("LOADING GAME %s\n", game_name);
+	got = read_game(m, game_name);
+	if (got == LOAD_MISSING)
+	{
+		printf("Error, not found %s.\n", game_name);
+		exit(1);
+	}
+	if (got == LOAD_TOO_BIG)
+	{
+		printf("Error, %s is bigger than %d bytes.\n", game_name, ROM_MAX);
+		exit(1);
+	}
+}
@@ -1,24 +1,257 @@
-#ifndef _MACHINE_H
-#define _MACHINE_H
-
-#include <stdio.h>
-#include <stdlib.h>
+#ifndef _MACHINE_H
+#define _MACHINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include "SDL/SDL.h"
+#include <stdint.h>
 
-// Display limits
+// Display limits, and in the high resolution mode of the SUPER-CHIP
 
 #define X_MAX 64
 #define Y_MAX 32
+#define X_HIRES 128
+#define Y_HIRES 64
+
+// Where Fx30 finds the 10 byte digits of the SUPER-CHIP, in CHIP8.ROM after the small ones
+
+#define FONT_HIRES 0x50
 
 // To see in bigger scale
 
 #define SCALE 5
-
-typedef unsigned char u8;
-typedef unsigned short u16;
-
-void instruction_execute (SDL_Event *Events);
-
-#endif
+
+// Instructions for every tick of the 60 Hz clock, unless told otherwise
+
+#define CLOCK 60
+
+// Largest game, from 0x200 to the end of memory
+
+#define ROM_MAX (4096 - 0x200)
+
+// What read_rom and read_game tell
+
+#define LOAD_OK 1
+#define LOAD_MISSING 0
+#define LOAD_TOO_BIG -1
+
+// Ways of running the machine
+
+#define ENGINE_SWITCH 0
+#define ENGINE_CACHE 1
+#define ENGINE_THREADED 2
+#define ENGINE_JIT 3
+#define ENGINE_AOT 4
+
+/*
+
+Quirks
+
+Chip-8 interpreters do not agree on what some instructions do, so every
+machine has a set of quirks, the game asks for one by its hash. With none
+set it is this emulator as it always was.
+
+	QUIRK_SHIFT_VY	8xy6 and 8xyE shift Vy into Vx, as the COSMAC VIP, not Vx
+	QUIRK_KEEP_I	Fx55 and Fx65 leave I as it was, instead of past the last register
+	QUIRK_JUMP_VX	Bxnn jumps to xnn + Vx, as the SUPER-CHIP, not to nnn + V0
+	QUIRK_CLIP	sprites past the edge of the screen are cut, not wrapped
+
+The first three change ops; see QUIRK_EACH in ops.h for how every engine
+is built once for each set of them.
+
+*/
+
+#define QUIRK_SHIFT_VY 1
+#define QUIRK_KEEP_I 2
+#define QUIRK_JUMP_VX 4
+#define QUIRK_CLIP 8
+
+// The quirks that change ops, the engines are built once for each set of them
+
+#define QUIRK_OPS (QUIRK_SHIFT_VY | QUIRK_KEEP_I | QUIRK_JUMP_VX)
+#define QUIRK_SETS (QUIRK_OPS + 1)
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+/*
+
+Machine
+
+Everything a running Chip-8 owns. Several machines can live in the same
+process, each one is only touched through the pointer passed around.
+
+*/
+
+// Pixel of Display, 0 or 1
+
+#define PIXEL(m, x, y) (((m)->Display[(y)][(x) >> 6] >> (63 - ((x) & 63))) & 1)
+
+// Size of the screen in the mode the machine is in
+
+#define COLUMNS(m) ((m)->hires ? X_HIRES : X_MAX)
+#define LINES(m) ((m)->hires ? Y_HIRES : Y_MAX)
+
+// Every line of the screen, for dirty
+
+#define ALL_LINES(m) (~(u64) 0 >> (64 - LINES(m)))
+
+typedef struct Machine Machine;
+typedef struct Instr Instr;
+typedef struct Jit Jit;
+typedef struct Trace Trace;
+typedef struct Page Page;
+
+/*
+
+Decoded instruction
+
+What the decoder learns from an opcode, so it only has to be done once.
+op tells which instruction it is (OP_* in ops.h), the rest are its operands.
+target is where the threaded engine jumps to run it, 0 until it is decoded.
+
+*/
+
+struct Instr
+{
+	int target;
+	u16 ir;
+	u16 nnn;
+	u8 op;
+	u8 x;
+	u8 y;
+	u8 kk;
+	u8 n;
+};
+
+struct Machine
+{
+	// Memory 4 KB (4,096 bytes) of RAM
+	u8 memory[4096];
+
+	// Registers from V0 to VF
+	u8 V[16];
+
+	// Register for save 16 bits address
+	u16 I;
+
+	// Instruction Register
+	u16 IR;
+
+	// Program Counter
+	u16 PC;
+
+	// Stack, array of 16 positions, 16 bits each block
+	u16 stack[16];
+
+	// Stack Pointer, index of the top of the stack
+	u8 SP;
+
+	/*
+
+	Timers
+
+	delay timer and sound timer
+
+	delay timer
+
+	sound timer when non-zero make a beep
+
+	both runs at 60 Hz (60 cycles)
+
+	*/
+
+	u16 DT;
+	u16 ST;
+
+	// Instructions run between two ticks of the timers, a frame
+	unsigned int ipf;
+
+	// Timer ticks since power on
+	unsigned long frame;
+
+	/*
+
+	Display, one bit per pixel and two words per line, the top bit of the
+	first one is x = 0 and the top bit of the second one x = 64. In low
+	resolution only the first word of the first Y_MAX lines is used, so
+	games of the original machine pay for nothing more than before.
+
+	*/
+
+	u64 Display [Y_HIRES][2];
+
+	// 128 x 64 pixels since 00FF, 64 x 32 since 00FE and at power on
+	u8 hires;
+
+	// User flags of the SUPER-CHIP, the RPL registers of its calculator
+	u8 flags[16];
+
+	// Lines of Display changed since they were last shown, bit y for line y
+	u64 dirty;
+
+	// QUIRK_*, load_game picks them for the ROM, machine_flush after changing them
+	u8 quirks;
+
+	// Hash of the game loaded, see rom_hash
+	unsigned long rom;
+
+	// Decoded instruction for every even address
+	Instr code[2048];
+	u8 engine;
+
+	// Translated blocks of the jit engine, made the first time it runs
+	Jit *jit;
+
+	// Keypad, bit k is set while key k is down, filled once per frame
+	u16 keys;
+
+	// Stopped at Fx0A until a key is down, only the timers run meanwhile
+	u8 waiting;
+
+	// Random numbers for Cxkk, xorshift, never 0
+	u32 rng;
+
+	// Where every instruction run is recorded, see trace.h, NULL for none
+	Trace *trace;
+
+	// Pages memory last matched, shared with the forks taken from it, see fork.h
+	Page *page[16];
+
+	// Bit p is set when page p of memory was written since it matched page[p]
+	u16 written;
+};
+
+void machine_init (Machine *m);
+void load_rom (Machine *m);
+void load_game (Machine *m, char *game_name);
+int read_rom (Machine *m);
+int read_game (Machine *m, char *game_name);
+unsigned long rom_hash (u8 *data, int size);
+u8 rom_quirks (unsigned long rom);
+int quirks_parse (char *list, u8 *quirks);
+
+void machine_free (Machine *m);
+void machine_seed (Machine *m, u32 seed);
+void machine_flush (Machine *m);
+void machine_run (Machine *m);
+void machine_skip (Machine *m, unsigned long frames);
+int machine_idle (Machine *m, unsigned int left);
+void machine_step (Machine *m);
+void threaded_run (Machine *m, unsigned int left);
+void jit_run (Machine *m, unsigned int left);
+void jit_invalidate (Machine *m, u16 address);
+void jit_flush (Machine *m);
+void jit_free (Machine *m);
+void aot_run (Machine *m, unsigned int left);
+void instruction_execute (Machine *m);
+void instr_decode (Instr *in, u16 ir);
+void draw_sprite (Machine *m, u8 x, u8 y, u8 n);
+void scroll_down (Machine *m, u8 n);
+void scroll_side (Machine *m, int by);
+void screen_mode (Machine *m, u8 hires);
+
+#endif
@@ -15,194 +15,466 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 */
 
 #include "machine.h"
+#include "script.h"
+#include "sched.h"
+#include "rewind.h"
+#include "profile.h"
+#include "trace.h"
+#include <limits.h>
+#ifndef HEADLESS
+#include "screen.h"
+#endif
+
+void usage(char *name)
+{
+	printf("Usage: %s [options] game\n", name);
+	printf("  -headless      run without a window, never waits for the clock; waiting for a key\n");
+	printf("                 skips straight to the next change of -input, or ends the run\n");
+	printf("  -frames n      stop after n frames\n");
+	printf("  -ipf n         instructions per frame, %d by default\n", CLOCK);
+	printf("  -unthrottled   do not wait for the 60 Hz clock, headless runs never do\n");
+	printf("  -stats         print speed and clock drift when done\n");
+	printf("  -load file     start from a saved state\n");
+	printf("  -save file     save the state when done\n");
+	printf("  -rewind kb     history kept for rewinding, 0 for none, 1024 in a window\n");
+	printf("  -rewind-every n  keep the state every n frames, 1 by default\n");
+	printf("  -back n        step n states back when done\n");
+	printf("  -wrap, -clip   sprites past the edge wrap around or are cut\n");
+	printf("  -quirks list   quirks instead of the ROM's, from shift-vy, keep-i, jump-vx, clip,\n");
+	printf("                 vip, schip and none, separated by commas\n");
+	printf("  -input file    read the keyboard from a script or a recording\n");
+	printf("  -record file   write the keys and the seed to play it back\n");
+	printf("  -seed n        seed for random numbers, from the clock by default\n");
+	printf("  -engine name   switch (default), cache, threaded, jit or aot\n");
+	printf("  -trace file    keep the last instructions run, written to file at the end or on a crash\n");
+}
 
-// Memory 4 KB (4,096 bytes) of RAM
-
-u8 memory[4096];
-
-// Registers from V0 to VF
-
-u8 V[16];
-
-// Register for save 16 bits address
-
-u16 I = 0;
-
-// Instruction Register
-
-u16 IR;
-
-// Program Counter
-
-u16 PC;
-
-// Stack, array of 16 positions, 16 bits each block
-
-u16 stack[16];
-
-// Stack Pointer
-
-u16 *SP;
-
-/*
-
-Timers
-
-delay timer and sound timer
-
-delay timer
-
-sound timer when non-zero make a beep
-
-both runs at 60 Hz (60 cycles)
-
-*/
-
-u16 DT;
-u16 ST;
-
-// Clock of 60 Hz
-
-#define CLOCK 60
-
-u8 cycles = CLOCK;
-
-// Display
-
-u8 Display [X_MAX][Y_MAX];
-SDL_Surface *scr;
+void print_display(Machine *m)
+{
+	u8 x, y;
+	
+	for (y = 0; y < LINES(m); y++)
+	{
+		for (x = 0; x < COLUMNS(m); x++)
+		{
+			putchar(PIXEL(m, x, y) ? '#' : '.');
+		}
+		putchar('\n');
+	}
+}
 
-SDL_Surface *init_SDL();
-void load_rom();
-void load_game(char *game_name);
+void wait_key(Machine *m, Scheduler *sched, Script *script, unsigned char headless, unsigned long frames, u16 *keys, u8 *back, unsigned char *running)
+{
+	// The machine is stopped at Fx0A with no key down, nothing runs until one is
+	
+	unsigned long until = ULONG_MAX;
+	
+	if (script != NULL || headless)
+	{
+		if (sched->throttle)
+		{
+			// Frames keep coming at 60 Hz, and they only tick the timers
+			return;
+		}
+		
+		// No one to wait for, jump to the frame where the keys change
+		if (script != NULL)
+		{
+			until = script_next_change(script);
+		}
+		if (frames != 0 && until > frames)
+		{
+			until = frames;
+		}
+		if (until == ULONG_MAX)
+		{
+			// A key will never come
+			*running = 0;
+		}
+		else if (until > m->frame)
+		{
+			machine_skip(m, until - m->frame);
+		}
+		if (frames != 0 && m->frame >= frames)
+		{
+			*running = 0;
+		}
+	}
+#ifndef HEADLESS
+	else if (m->DT == 0 && m->ST == 0)
+	{
+		// Not even the timers move, sleep until the user does something
+		if (!screen_wait(keys, back))
+		{
+			*running = 0;
+		}
+		sched_resync(sched);
+	}
+#endif
+}
 
 int main(int argv, char *argc[])
 {
-	PC = 0x200;
-	SP = &stack[0];
-	DT = 0;
-	ST = 0;
+	Machine machine;
+	Machine *m = &machine;
+	Script script;
+	Scheduler sched;
+	
+	char *game_name = NULL;
+	char *input_name = NULL;
+	char *load_name = NULL;
+	char *trace_name = NULL;
+	char *record_name = NULL;
+	Record record;
+	u32 seed = 0;
+	u8 has_seed = 0;
+	char *save_name = NULL;
+	static u8 boot[4096];
+	static Rewind rewind;
+	long rewind_kb = -1;
+	unsigned int rewind_every = 1;
+	unsigned long back_steps = 0;
+	unsigned long frames = 0;
+	u8 engine = ENGINE_SWITCH;
+	int edge = -1;
+	u8 quirks = 0;
+	u8 quirks_given = 0;
+	unsigned int ipf = CLOCK;
+	u8 throttle = 1;
+	u8 stats = 0;
+#ifdef HEADLESS
+	unsigned char headless = 1;
+#else
+	unsigned char headless = 0;
+#endif
+	int arg;
+	
+	for (arg = 1; arg < argv; arg++)
+	{
+		if (strcmp(argc[arg], "-headless") == 0)
+		{
+			headless = 1;
+		}
+		else if (strcmp(argc[arg], "-frames") == 0 && arg + 1 < argv)
+		{
+			frames = strtoul(argc[++arg], NULL, 10);
+		}
+		else if (strcmp(argc[arg], "-ipf") == 0 && arg + 1 < argv)
+		{
+			ipf = strtoul(argc[++arg], NULL, 10);
+		}
+		else if (strcmp(argc[arg], "-unthrottled") == 0)
+		{
+			throttle = 0;
+		}
+		else if (strcmp(argc[arg], "-stats") == 0)
+		{
+			stats = 1;
+		}
+		else if (strcmp(argc[arg], "-record") == 0 && arg + 1 < argv)
+		{
+			record_name = argc[++arg];
+		}
+		else if (strcmp(argc[arg], "-seed") == 0 && arg + 1 < argv)
+		{
+			seed = strtoul(argc[++arg], NULL, 0);
+			has_seed = 1;
+		}
+		else if (strcmp(argc[arg], "-load") == 0 && arg + 1 < argv)
+		{
+			load_name = argc[++arg];
+		}
+		else if (strcmp(argc[arg], "-save") == 0 && arg + 1 < argv)
+		{
+			save_name = argc[++arg];
+		}
+		else if (strcmp(argc[arg], "-rewind") == 0 && arg + 1 < argv)
+		{
+			rewind_kb = strtol(argc[++arg], NULL, 10);
+		}
+		else if (strcmp(argc[arg], "-rewind-every") == 0 && arg + 1 < argv)
+		{
+			rewind_every = strtoul(argc[++arg], NULL, 10);
+		}
+		else if (strcmp(argc[arg], "-back") == 0 && arg + 1 < argv)
+		{
+			back_steps = strtoul(argc[++arg], NULL, 10);
+		}
+		else if (strcmp(argc[arg], "-wrap") == 0)
+		{
+			edge = 0;
+		}
+		else if (strcmp(argc[arg], "-clip") == 0)
+		{
+			edge = QUIRK_CLIP;
+		}
+		else if (strcmp(argc[arg], "-quirks") == 0 && arg + 1 < argv)
+		{
+			if (!quirks_parse(argc[++arg], &quirks))
+			{
+				usage(argc[0]);
+				return 1;
+			}
+			quirks_given = 1;
+		}
+		else if (strcmp(argc[arg], "-trace") == 0 && arg + 1 < argv)
+		{
+			trace_name = argc[++arg];
+		}
+		else if (strcmp(argc[arg], "-input") == 0 && arg + 1 < argv)
+		{
+			input_name = argc[++arg];
+		}
+		else if (strcmp(argc[arg], "-engine") == 0 && arg + 1 < argv)
+		{
+			arg++;
+			if (strcmp(argc[arg], "switch") == 0)
+			{
+				engine = ENGINE_SWITCH;
+			}
+			else if (strcmp(argc[arg], "cache") == 0)
+			{
+				engine = ENGINE_CACHE;
+			}
+			else if (strcmp(argc[arg], "threaded") == 0)
+			{
+				engine = ENGINE_THREADED;
+			}
+			else if (strcmp(argc[arg], "jit") == 0)
+			{
+				engine = ENGINE_JIT;
+			}
+			else if (strcmp(argc[arg], "aot") == 0)
+			{
+				engine = ENGINE_AOT;
+			}
+			else
+			{
+				usage(argc[0]);
+				return 1;
+			}
+		}
+		else if (argc[arg][0] == '-')
+		{
+			usage(argc[0]);
+			return 1;
+		}
+		else
+		{
+			game_name = argc[arg];
+		}
+	}
 
-	scr = init_SDL();
-	SDL_Event Events;
+#ifdef PROFILE
+	// Only the switch engine runs one instruction at a time to be timed
+	engine = ENGINE_SWITCH;
+#endif
+	machine_init(m);
+	m->engine = engine;
+	m->ipf = ipf;
 
-	// Getting pseudo-random numbers
-	srand (time(NULL));
 	// Loading ROM in memory
-	load_rom();
+	load_rom(m);
 	// Loading game in memory
-    if (argv > 1)
-    {
-        load_game(argc[1]);
-    }
-    else
-    {
-        printf("No Game!\n");
-        return 0;
-    }
-    
-    unsigned char running = 1;
+	if (game_name != NULL)
+	{
+		load_game(m, game_name);
+		// The ROM picks its own unless told otherwise
+		if (quirks_given)
+		{
+			m->quirks = quirks;
+		}
+		if (edge >= 0)
+		{
+			m->quirks = (m->quirks & ~QUIRK_CLIP) | edge;
+		}
+		machine_flush(m);
+		
+		// Saved states only keep what changed from here
+		memcpy(boot, m->memory, sizeof(boot));
+		if (load_name != NULL && !state_load(m, boot, load_name))
+		{
+			printf("Error, %s is not a state of this game.\n", load_name);
+			return 1;
+		}
+	}
+	else
+	{
+		printf("No Game!\n");
+		return 0;
+	}
+	
+	// Keyboard comes from a script or from the window
+	if (input_name != NULL)
+	{
+		if (!script_open(&script, input_name))
+		{
+			printf("Error, not found %s.\n", input_name);
+			return 1;
+		}
+		if (!has_seed && script.has_seed)
+		{
+			seed = script.seed;
+			has_seed = 1;
+		}
+	}
+	
+	// Random numbers, a saved state brings its own
+	if (!has_seed)
+	{
+		seed = (u32) time(NULL);
+	}
+	if (has_seed || load_name == NULL)
+	{
+		machine_seed(m, seed);
+	}
+	
+	// Instructions are only recorded one at a time, by the switch engine
+	if (trace_name != NULL)
+	{
+		m->trace = trace_open(trace_name, m->rom);
+		if (m->trace == NULL)
+		{
+			printf("Error, can not write %s.\n", trace_name);
+			return 1;
+		}
+		trace_catch(m->trace);
+		m->engine = ENGINE_SWITCH;
+	}
+	if (record_name != NULL && !record_open(&record, record_name, m->rng))
+	{
+		printf("Error, can not write %s.\n", record_name);
+		return 1;
+	}
+#ifndef HEADLESS
+	if (!headless)
+	{
+		if (!screen_init())
+		{
+			printf("Error, can not open the window.\n");
+			return 1;
+		}
+	}
+#endif
+	
+	// History for rewinding, on by default only when someone can use it
+	// A recording can not go back in time
+	if (rewind_kb < 0)
+	{
+		rewind_kb = ((!headless || back_steps > 0) && record_name == NULL) ? 1024 : 0;
+	}
+	if (rewind_kb > 0 && record_name != NULL)
+	{
+		printf("Error, can not rewind while recording.\n");
+		return 1;
+	}
+	if (rewind_kb > 0)
+	{
+		if (!rewind_init(&rewind, rewind_kb * 1024, rewind_every))
+		{
+			printf("Error, no memory for %ld KB of rewind.\n", rewind_kb);
+			return 1;
+		}
+		rewind_frame(&rewind, m);
+	}
+	
+	unsigned char running = 1;
+	u16 keys = 0;
+	u8 back = 0;
 
+	// Nobody is watching a headless run, no need to wait for the clock
+	sched_init(&sched, throttle && !headless);
 	while (running == 1)
 	{
-		// fetch
-		IR = memory[PC++];
-		IR = ((IR << 8) | memory[PC]);
-		// Decreasing cycle of clock
-		cycles--;
-		// Decode and execution
-		instruction_execute (&Events);
+		if (back && rewind.ring != NULL)
+		{
+			// Going backwards a state per frame instead of running
+			rewind_back(&rewind, m);
+		}
+		else
+		{
+			// The keypad is read once per frame and stays put while it runs
+			if (input_name != NULL)
+			{
+				m->keys = script_keys(&script, m->frame);
+			}
+			else
+			{
+				m->keys = keys;
+			}
+			if (record_name != NULL)
+			{
+				record_keys(&record, m->frame, m->keys);
+			}
+			machine_run(m);
+			if (rewind.ring != NULL)
+			{
+				rewind_frame(&rewind, m);
+			}
+		}
 		// Sound maker :P
-		if (DT != 0)
+		if (m->DT != 0)
 		{
 			//printf("\7");
 		}
-		if (cycles <= 0)
+		if (frames != 0 && m->frame >= frames)
 		{
-			DT--;
-			ST--;
-			cycles = CLOCK;
+			running = 0;
 		}
-
-		while (SDL_PollEvent(&Events))
+#ifndef HEADLESS
+		if (!headless)
 		{
-			switch(Events.type)
+			if (m->dirty)
+			{
+				screen_render(m);
+			}
+			if (!screen_poll(&keys, &back))
 			{
-				case SDL_QUIT:
-					running = 0;
-					break;
-				case SDL_KEYDOWN:
-					switch (Events.key.keysym.sym)
-					{
-						case SDLK_ESCAPE:
-							running = 0;
-							break;
-						default:
-							break;
-					}
-					break;
+				running = 0;
 			}
 		}
+#endif
+		if (running && m->waiting && !back)
+		{
+			wait_key(m, &sched, input_name != NULL ? &script : NULL, headless, frames, &keys, &back, &running);
+		}
+		sched_frame(&sched);
 	}
-
-	return 0;
-}
-
-SDL_Surface* init_SDL()
-{
-	SDL_Init(SDL_INIT_VIDEO);
-	SDL_Surface *screen;
-	screen = SDL_SetVideoMode((X_MAX * SCALE), (Y_MAX * SCALE), 8, SDL_SWSURFACE);
-	SDL_WM_SetCaption("Another chip-8 emulator", 0);
-	SDL_Color palette[] =
-	{
-		{0, 0, 0, 0},
-		{255, 255, 255, 255}
-	};
-	SDL_SetPalette(screen, SDL_LOGPAL|SDL_PHYSPAL, palette, 0, 2);
-	return screen;
-}
-
-void load_rom()
-{
-	FILE *rom;
-	rom = fopen("CHIP8.ROM", "r");
-	if (rom == NULL)
+	
+	if (stats)
 	{
-		printf("Error, no encontrado \"CHIP8.ROM\"n.");
-		exit(1);
+		sched_report(&sched, stderr);
 	}
-	else
+#ifdef PROFILE
+	profile_report(m, stderr);
+#endif
+	if (m->trace != NULL)
 	{
-		short cont_chars = 0;
-		while(!feof(rom))
-		{
-			memory[cont_chars] = fgetc(rom);
-			cont_chars++;
-		}
+		trace_close(m->trace);
+		m->trace = NULL;
 	}
-	fclose(rom);
-}
-
-void load_game(char *game_name)
-{
-	FILE *game;
-	printf("LOADING GAME %s\n", game_name);
-	game = fopen(game_name, "r");
-	if (game == NULL)
+	while (back_steps > 0 && rewind.ring != NULL && rewind_back(&rewind, m))
 	{
-		printf("Error, not found %s.\n", game_name);
-		exit(1);
+		back_steps--;
 	}
-	else
+	if (save_name != NULL && !state_save(m, boot, save_name))
 	{
-		short cont_bytes = 0;
-		while(!feof(game))
-		{
-			// Put game in memory
-			memory[cont_bytes+0x200] = fgetc(game);
-			cont_bytes++;
-		}
+		printf("Error, can not save %s.\n", save_name);
+	}
+	if (headless)
+	{
+		print_display(m);
 	}
-	fclose(game);
+	if (input_name != NULL)
+	{
+		script_close(&script);
+	}
+	if (record_name != NULL)
+	{
+		record_close(&record);
+	}
+	rewind_free(&rewind);
+	machine_free(m);
+
+	return 0;
 }
@@ -0,0 +1,1077 @@
+#ifndef _OPS_H
+#define _OPS_H
+
+/*
+
+Chip-8 instructions
+
+One function for each instruction, shared by every way of running the
+machine. When they get here PC already points to the second byte of the
+instruction, as the fetch left it.
+
+The few that depend on the quirks (see machine.h) take them as an argument.
+Engines pass a constant there, so the one behaviour they were built for is
+all that is left of them, see QUIRK_EACH.
+
+*/
+
+#include "machine.h"
+
+// What a decoded instruction is, OP_DECODE means not decoded yet
+
+enum
+{
+	OP_DECODE,
+	OP_CLS,
+	OP_RET,
+	OP_SYS,
+	OP_JP,
+	OP_CALL,
+	OP_SE_BYTE,
+	OP_SNE_BYTE,
+	OP_SE_REG,
+	OP_LD_BYTE,
+	OP_ADD_BYTE,
+	OP_LD_REG,
+	OP_OR,
+	OP_AND,
+	OP_XOR,
+	OP_ADD_REG,
+	OP_SUB,
+	OP_SHR,
+	OP_SUBN,
+	OP_SHL,
+	OP_SNE_REG,
+	OP_LD_I,
+	OP_JP_V0,
+	OP_RND,
+	OP_DRW,
+	OP_SKP,
+	OP_SKNP,
+	OP_LD_VX_DT,
+	OP_LD_KEY,
+	OP_LD_DT,
+	OP_LD_ST,
+	OP_ADD_I,
+	OP_LD_F,
+	OP_LD_B,
+	OP_LD_MEM,
+	OP_LD_REG_MEM,
+	OP_SCD,
+	OP_SCR,
+	OP_SCL,
+	OP_EXIT,
+	OP_LOW,
+	OP_HIGH,
+	OP_LD_HF,
+	OP_LD_R,
+	OP_LD_VX_R,
+	OP_NONE,
+	OP_COUNT
+};
+
+/*
+
+Quirk variants
+
+QUIRK_EACH(define) expands define(q) for every set q of QUIRK_OPS, so an
+engine written as an always inline function with a const quirks argument
+gets a copy of itself for each one, and QUIRK_TABLE(f) is the table of
+f_0 to f_7 to pick from with m->quirks & QUIRK_OPS. The choice is made
+once per frame, nothing on the way of an instruction asks for the quirks.
+
+*/
+
+#define QUIRK_EACH(define) define(0) define(1) define(2) define(3) define(4) define(5) define(6) define(7)
+#define QUIRK_TABLE(f) { f##_0, f##_1, f##_2, f##_3, f##_4, f##_5, f##_6, f##_7 }
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// The quirk an op depends on, 0 for none
+
+static inline u8 op_quirk (u8 op)
+{
+	switch (op)
+	{
+		case OP_SHR:
+		case OP_SHL:
+			return QUIRK_SHIFT_VY;
+
+		case OP_JP_V0:
+			return QUIRK_JUMP_VX;
+
+		case OP_LD_MEM:
+		case OP_LD_REG_MEM:
+			return QUIRK_KEEP_I;
+	}
+
+	return 0;
+}
+
+static inline u8 rng_next (Machine *m)
+{
+	// xorshift32, the top byte is the best mixed
+	
+	u32 x = m->rng;
+	
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	m->rng = x;
+	return x >> 24;
+}
+
+static inline u16 BIN2BCD (u8 a, short b)
+{
+	switch(b)
+	{
+		case 1:
+			return a%10;
+			break;
+		case 2:
+			return (a%100)/10;
+			break;
+		case 3:
+			return a/100;
+			break;
+		default:
+			return 0;
+			break;
+	}
+	return 0;
+}
+
+static inline void mem_write (Machine *m, u16 address, u8 value)
+{
+	// Writing over code throws away what was decoded there
+
+	address &= 0xFFF;
+	m->memory[address] = value;
+	m->written |= 1 << (address >> 8);
+	m->code[address >> 1].op = OP_DECODE;
+	m->code[address >> 1].target = 0;
+	if (m->jit != NULL)
+	{
+		jit_invalidate(m, address);
+	}
+}
+
+/*
+
+00E0 - CLS
+Clear the display.
+
+*/
+
+static inline void op_cls (Machine *m, Instr *in)
+{
+	m->PC++;
+	
+	memset(m->Display, 0, sizeof(m->Display));
+	m->dirty = ALL_LINES(m);
+
+	//printf("0x00E0 - CLS\n");
+}
+
+/*
+
+00EE - RET
+Return from a subroutine.
+
+The interpreter sets the program counter to the address at the top of the stack,
+then subtracts 1 from the stack pointer.
+
+*/
+
+static inline void op_ret (Machine *m, Instr *in)
+{
+	m->PC = m->stack[m->SP & 0xF];
+	m->SP--;
+	//printf("0x00EE - RET\n");
+}
+
+/*
+
+0nnn - SYS addr
+Jump to a machine code routine at nnn.
+
+This instruction is only used on the old computers on which Chip-8 was originally implemented.
+It is ignored by modern interpreters.
+
+*/
+
+static inline void op_sys (Machine *m, Instr *in)
+{
+	m->PC++;
+#ifndef HEADLESS
+	// Only a window has someone at the terminal to go on
+	getchar();
+#endif
+	//printf("0x0nnn - SYS nnn\n");
+}
+
+/*
+
+1nnn - JP addr
+Jump to location nnn.
+
+The interpreter sets the program counter to nnn.
+
+*/
+
+static inline void op_jp (Machine *m, Instr *in)
+{
+	m->PC = in->nnn;
+	//printf("0x1%03X - JP 0x%03X\n", m->PC, m->PC);
+}
+
+/*
+
+2nnn - CALL addr
+Call subroutine at nnn.
+
+The interpreter increments the stack pointer, then puts the current PC on the top of the stack.
+The PC is then set to nnn.
+
+*/
+
+static inline void op_call (Machine *m, Instr *in)
+{
+	m->PC++;
+	m->SP++;
+	m->stack[m->SP & 0xF] = m->PC;
+	m->PC = in->nnn;
+	//printf("0x2%03X - CALL 0x%03X\n", m->PC, m->PC);
+}
+
+/*
+
+3xkk - SE Vx, byte
+Skip next instruction if Vx = kk.
+
+The interpreter compares register Vx to kk, and if they are equal,
+increments the program counter by 2
+
+*/
+
+static inline void op_se_byte (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	if (m->V[in->x] == in->kk)
+	{
+		m->PC += 2;
+	}
+
+	//printf("0x3%X%02X - SE V%X, 0x%02X\n", in->x, in->kk, in->x, in->kk);
+}
+
+/*
+
+4xkk - SNE Vx, byte
+Skip next instruction if Vx != kk.
+
+The interpreter compares register Vx to kk, and if they are not equal,
+increments the program counter by 2.
+
+*/
+
+static inline void op_sne_byte (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	if (m->V[in->x] != in->kk)
+	{
+		m->PC += 2;
+	}
+
+	//printf("0x4%X%02X - SNE V%X, 0x%02X\n", in->x, in->kk, in->x, in->kk);
+}
+
+/*
+
+5xy0 - SE Vx, Vy
+Skip next instruction if Vx = Vy.
+
+The interpreter compares register Vx to register Vy, and if they are equal,
+increments the program counter by 2.
+
+*/
+
+static inline void op_se_reg (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	if (m->V[in->x] == m->V[in->y])
+	{
+		m->PC += 2;
+	}
+
+	//printf("0x5%X%X0 - SE V%X, V%X\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+6xkk - LD Vx, byte
+Set Vx = kk.
+
+The interpreter puts the value kk into register Vx.
+
+*/
+
+static inline void op_ld_byte (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->V[in->x] = in->kk;
+
+	//printf("0x6%X%02X - LD V%X, 0x%03X\n", in->x, in->kk, in->x, in->kk);
+}
+
+/*
+
+7xkk - ADD Vx, byte
+Set Vx = Vx + kk.
+
+Adds the value kk to the value of register Vx, then stores the result in Vx.
+
+*/
+
+static inline void op_add_byte (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->V[in->x] += in->kk;
+
+	//printf("0x7%X%02X - ADD V%X, 0x%02X\n", in->x, in->kk, in->x, in->kk);
+}
+
+/*
+
+8xy0 - LD Vx, Vy
+Set Vx = Vy.
+
+Stores the value of register Vy in register Vx.
+
+*/
+
+static inline void op_ld_reg (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->V[in->x] = m->V[in->y];
+
+	//printf("0x8%X%X0 - LD V%X, V%X\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+8xy1 - OR Vx, Vy
+Set Vx = Vx OR Vy.
+
+Performs a bitwise OR on the values of Vx and Vy, then stores the result in Vx.
+A bitwise OR compares the corrseponding bits from two values, and if either bit is 1,
+then the same bit in the result is also 1. Otherwise, it is 0.
+
+*/
+
+static inline void op_or (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->V[in->x] |= m->V[in->y];
+
+	//printf("0x8%X%X1 - OR V%X, V%X\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+8xy2 - AND Vx, Vy
+Set Vx = Vx AND Vy.
+
+Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx.
+A bitwise AND compares the corrseponding bits from two values, and if both bits are 1,
+then the same bit in the result is also 1. Otherwise, it is 0.
+
+*/
+
+static inline void op_and (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->V[in->x] &= m->V[in->y];
+
+	//printf("0x8%X%X2 - AND V%X, V%X\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+8xy3 - XOR Vx, Vy
+Set Vx = Vx XOR Vy.
+
+Performs a bitwise exclusive OR on the values of Vx and Vy, then stores the result in Vx.
+An exclusive OR compares the corrseponding bits from two values,
+and if the bits are not both the same, then the corresponding bit in the result is set to 1.
+Otherwise, it is 0.
+
+*/
+
+static inline void op_xor (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->V[in->x] ^= m->V[in->y];
+
+	//printf("0x8%X%X3 - XOR V%X, V%X\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+8xy4 - ADD Vx, Vy
+Set Vx = Vx + Vy, set VF = carry.
+
+The values of Vx and Vy are added together.
+If the result is greater than 8 bits (i.e., > 255) VF is set to 1, otherwise 0.
+Only the lowest 8 bits of the result are kept, and stored in Vx.
+
+*/
+
+static inline void op_add_reg (Machine *m, Instr *in)
+{
+	u8 z;
+
+	m->PC++;
+
+	z = m->V[in->x] + m->V[in->y];
+
+	if (m->V[in->x] > m->V[in->y])
+	{
+		m->V[0xF] = (m->V[in->x] > z) ? 1 : 0;
+	}
+	else
+	{
+		m->V[0xF] = (m->V[in->y] > z) ? 1 : 0;
+	}
+
+	m->V[in->x] = z;
+
+	//printf("0x8%X%X4 - ADD V%X, V%X\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+8xy5 - SUB Vx, Vy
+Set Vx = Vx - Vy, set VF = NOT borrow.
+
+If Vx > Vy, then VF is set to 1, otherwise 0.
+Then Vy is subtracted from Vx, and the results stored in Vx.
+
+*/
+
+static inline void op_sub (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->V[0xF] = (m->V[in->x] > m->V[in->y]) ? 1 : 0;
+
+	m->V[in->x] -= m->V[in->y];
+
+	//printf("0x8%X%X5 - SUB V%X, V%X\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+8xy6 - SHR Vx {, Vy}
+Set Vx = Vx SHR 1.
+
+If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0.
+Then Vx is divided by 2.
+
+With QUIRK_SHIFT_VY it is Vy that is shifted, the result still goes to Vx.
+
+*/
+
+static inline void op_shr (Machine *m, Instr *in, const u8 quirks)
+{
+	u8 s = (quirks & QUIRK_SHIFT_VY) ? in->y : in->x;
+
+	m->PC++;
+
+	m->V[0xF] = ((m->V[s] & 0x01) == 0x1) ? 1 : 0;
+	m->V[in->x] = m->V[s] >> 1;
+
+	//printf("0x8%X%X6 - SHR V%X {, V%X}\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+8xy7 - SUBN Vx, Vy
+Set Vx = Vy - Vx, set VF = NOT borrow.
+
+If Vy > Vx, then VF is set to 1, otherwise 0.
+Then Vx is subtracted from Vy, and the results stored in Vx.
+
+*/
+
+static inline void op_subn (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->V[0xF] = (m->V[in->y] > m->V[in->x]) ? 1 : 0;
+
+	m->V[in->x] -= m->V[in->y];
+
+	//printf("0x8%X%X7 - SUBN V%X, V%X\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+8xyE - SHL Vx {, Vy}
+
+Set Vx = Vx SHL 1.
+
+If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0.
+Then Vx is multiplied by 2.
+
+With QUIRK_SHIFT_VY it is Vy that is shifted, the result still goes to Vx.
+
+*/
+
+static inline void op_shl (Machine *m, Instr *in, const u8 quirks)
+{
+	u8 s = (quirks & QUIRK_SHIFT_VY) ? in->y : in->x;
+
+	m->PC++;
+
+	m->V[0xF] = (m->V[s] & 0x80) ? 1 : 0;
+
+	m->V[in->x] = m->V[s] << 1;
+
+	//printf("0x8%X%XE - SHL V%X {, V%X}\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+9xy0 - SNE Vx, Vy
+Skip next instruction if Vx != Vy.
+
+The values of Vx and Vy are compared, and if they are not equal,
+the program counter is increased by 2.
+
+*/
+
+static inline void op_sne_reg (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	if (m->V[in->x] != m->V[in->y])
+	{
+		m->PC += 2;
+	}
+
+	//printf("0x9%X%X0 - SNE V%X, V%X\n", in->x, in->y, in->x, in->y);
+}
+
+/*
+
+Annn - LD I, addr
+Set I = nnn.
+
+The value of register I is set to nnn.
+
+*/
+
+static inline void op_ld_i (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->I = in->nnn;
+
+	//printf("0xA%03X - LD I, 0x%03X\n", m->I, m->I);
+}
+
+/*
+
+Bnnn - JP V0, addr
+Jump to location nnn + V0.
+
+The program counter is set to nnn plus the value of V0.
+
+With QUIRK_JUMP_VX it is Bxnn, a jump to xnn plus the value of Vx.
+
+*/
+
+static inline void op_jp_v0 (Machine *m, Instr *in, const u8 quirks)
+{
+	m->PC = in->nnn + m->V[(quirks & QUIRK_JUMP_VX) ? in->x : 0x0];
+
+	//printf("0xB%03X - JP V0, 0x%03X\n", m->PC, m->PC);
+}
+
+/*
+
+Cxkk - RND Vx, byte
+Set Vx = random byte AND kk.
+
+The interpreter generates a random number from 0 to 255,
+which is then ANDed with the value kk. The results are stored in Vx.
+See instruction 8xy2 for more information on AND.
+
+*/
+
+static inline void op_rnd (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->V[in->x] = (rng_next(m) & in->kk);
+
+	//printf("0xC%X%02X - RND V%X, 0x%02X\n", in->x, in->kk, in->x, in->kk);
+}
+
+/*
+
+Dxyn - DRW Vx, Vy, nibble
+Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
+
+The interpreter reads n bytes from memory, starting at the address stored in I.
+These bytes are then displayed as sprites on screen at coordinates (Vx, Vy).
+Sprites are XORed onto the existing screen. If this causes any pixels to be erased,
+VF is set to 1, otherwise it is set to 0.
+If the sprite is positioned so part of it is outside the coordinates of the display,
+it wraps around to the opposite side of the screen.
+Dxy0 (SUPER-CHIP) draws a 16x16 sprite instead, two bytes a line.
+Two things are not as in the SUPER-CHIP 1.1 of the HP 48. VF is only ever
+0 or 1, where in 128x64 it gets the number of sprite lines that collided.
+And in 64x32, 00FB and 00FC scroll 4 of its pixels, where the SUPER-CHIP
+scrolls 2 of them (4 of the 128x64 screen). draw_wide in machine.c draws
+both kinds in 128x64 and Dxy0 in 64x32.
+See instruction 8xy3 for more information on XOR, and section 2.4, Display,
+for more information on the Chip-8 screen and sprites.
+
+*/
+
+static inline void op_drw (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	draw_sprite(m, in->x, in->y, in->n);
+
+	//printf("0xD%X%X%X - DRW V%X, V%X, 0x%X\n", in->x, in->y, in->n, in->x, in->y, in->n);
+}
+
+/*
+
+Ex9E - SKP Vx
+Skip next instruction if key with the value of Vx is pressed.
+
+Checks the keyboard,
+and if the key corresponding to the value of Vx is currently in the down position,
+PC is increased by 2.
+
+*/
+
+static inline void op_skp (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	if (m->V[in->x] < 16 && ((m->keys >> m->V[in->x]) & 1))
+	{
+		m->PC += 2;
+	}
+
+	//printf("0xE%X9E - SKP V%X\n", in->x, in->x);
+}
+
+/*
+
+ExA1 - SKNP Vx
+Skip next instruction if key with the value of Vx is not pressed.
+
+Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
+
+*/
+
+static inline void op_sknp (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	if (!(m->V[in->x] < 16 && ((m->keys >> m->V[in->x]) & 1)))
+	{
+		m->PC += 2;
+	}
+
+	//printf("0xE%XA1 - SKNP V%X\n", in->x, in->x);
+}
+
+/*
+
+Fx07 - LD Vx, DT
+Set Vx = delay timer value.
+
+The value of DT is placed into Vx.
+
+*/
+
+static inline void op_ld_vx_dt (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->V[in->x] = m->DT;
+
+	//printf("0xF%X07 - LD V%X, DT = 0x%X\n", in->x, in->x, m->DT);
+}
+
+/*
+
+Fx0A - LD Vx, K
+Wait for a key press, store the value of the key in Vx.
+
+All execution stops until a key is pressed, then the value of that key is stored in Vx.
+
+The keypad only changes between frames, so with no key down the machine
+is left waiting at this instruction and it runs again when a key is down.
+Meanwhile only the timers run. With several keys down the lowest one is taken.
+
+*/
+
+static inline void op_ld_key (Machine *m, Instr *in)
+{
+	u8 key;
+
+	m->PC++;
+
+	if (m->keys == 0)
+	{
+		m->PC -= 2;
+		m->waiting = 1;
+		return;
+	}
+	m->waiting = 0;
+
+	for (key = 0; !((m->keys >> key) & 1); key++)
+	{
+	}
+
+	m->V[in->x] = key;
+
+	//printf("0xF%X0A - LD V%X, DT = 0x%X\n", in->x, in->x, m->DT);
+}
+
+/*
+
+Fx15 - LD DT, Vx
+Set delay timer = Vx.
+
+DT is set equal to the value of Vx.
+
+*/
+
+static inline void op_ld_dt (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->DT = m->V[in->x];
+
+	//printf("0xF%X15 - LD DT = 0x%X, V%X\n", in->x, m->DT, in->x);
+}
+
+/*
+
+Fx18 - LD ST, Vx
+Set sound timer = Vx.
+
+ST is set equal to the value of Vx.
+
+*/
+
+static inline void op_ld_st (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->ST = m->V[in->x];
+
+	//printf("0xF%X18 - LD ST = 0x%X, V%X\n", in->x, m->ST, in->x);
+}
+
+/*
+
+Fx1E - ADD I, Vx
+Set I = I + Vx.
+
+The values of I and Vx are added, and the results are stored in I.
+
+*/
+
+static inline void op_add_i (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->I += m->V[in->x];
+
+	//printf("0xF%X1E - ADD I, V%X\n", in->x, in->x);
+}
+
+/*
+
+Fx29 - LD F, Vx
+Set I = location of sprite for digit Vx.
+
+The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx.
+See section 2.4, Display, for more information on the Chip-8 hexadecimal font.
+
+*/
+
+static inline void op_ld_f (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	// 5 Bytes representation per number
+
+	m->I = (5 * m->V[in->x]);
+
+	//printf("0xF%X29 - LD F, V%X\n", in->x, in->x);
+}
+
+/*
+
+Fx33 - LD B, Vx
+Store BCD representation of Vx in memory locations I, I+1, and I+2.
+
+The interpreter takes the decimal value of Vx,
+and places the hundreds digit in memory at location in I,
+the tens digit at location I+1, and the ones digit at location I+2.
+
+*/
+
+static inline void op_ld_b (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	// Revisar porque puede estar mal
+
+	mem_write(m, m->I, BIN2BCD(m->V[in->x], 3));
+	mem_write(m, m->I+1, BIN2BCD(m->V[in->x], 2));
+	mem_write(m, m->I+2, BIN2BCD(m->V[in->x], 1));
+
+	//printf("0xF%X33 - LD B, V%X\n", in->x, in->x);
+}
+
+/*
+
+Fx55 - LD [I], Vx
+Store registers V0 through Vx in memory starting at location I.
+
+The interpreter copies the values of registers V0 through Vx into memory,
+starting at the address in I. I ends past the last one, unless QUIRK_KEEP_I.
+
+*/
+
+static inline void op_ld_mem (Machine *m, Instr *in, const u8 quirks)
+{
+	u16 i;
+
+	m->PC++;
+
+	for (i = 0; (i <= in->x); i++)
+	{
+		mem_write(m, m->I + i, m->V[i]);
+	}
+
+	if (!(quirks & QUIRK_KEEP_I))
+	{
+		m->I += i;
+	}
+
+	//printf("0xF%X55 - LD [I], V%X\n", in->x, in->x);
+}
+
+/*
+
+Fx65 - LD Vx, [I]
+Read registers V0 through Vx from memory starting at location I.
+
+The interpreter reads values from memory starting at location I into registers V0 through Vx.
+I ends past the last one, unless QUIRK_KEEP_I.
+
+*/
+
+static inline void op_ld_reg_mem (Machine *m, Instr *in, const u8 quirks)
+{
+	u16 i;
+
+	m->PC++;
+
+	for(i = 0; (i <= in->x); i++)
+	{
+		m->V[i] = m->memory[(m->I + i) & 0xFFF];
+	}
+
+	if (!(quirks & QUIRK_KEEP_I))
+	{
+		m->I += i;
+	}
+
+	//printf("0xF%X65 - LD I, V[%X]\n", in->x, in->x);
+}
+
+/*
+
+SUPER-CHIP
+
+The instructions the SUPER-CHIP added, for its 128x64 mode and the
+calculator it ran on. Scrolls and modes go for the screen in the mode
+the machine is in, see scroll_down and scroll_side.
+
+00Cn - SCD nibble
+Scroll display n lines down, blank lines come in at the top.
+
+*/
+
+static inline void op_scd (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	scroll_down(m, in->n);
+
+	//printf("0x00C%X - SCD 0x%X\n", in->n, in->n);
+}
+
+/*
+
+00FB - SCR
+Scroll display 4 pixels right.
+
+*/
+
+static inline void op_scr (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	scroll_side(m, 4);
+
+	//printf("0x00FB - SCR\n");
+}
+
+/*
+
+00FC - SCL
+Scroll display 4 pixels left.
+
+*/
+
+static inline void op_scl (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	scroll_side(m, -4);
+
+	//printf("0x00FC - SCL\n");
+}
+
+/*
+
+00FD - EXIT
+Exit the interpreter.
+
+There is nothing to go back to, PC stays on it and it runs again and again.
+
+*/
+
+static inline void op_exit (Machine *m, Instr *in)
+{
+	m->PC--;
+
+	//printf("0x00FD - EXIT\n");
+}
+
+/*
+
+00FE - LOW
+Disable extended screen mode, back to 64x32. The screen is cleared.
+
+*/
+
+static inline void op_low (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	screen_mode(m, 0);
+
+	//printf("0x00FE - LOW\n");
+}
+
+/*
+
+00FF - HIGH
+Enable extended screen mode, 128x64. The screen is cleared.
+
+*/
+
+static inline void op_high (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	screen_mode(m, 1);
+
+	//printf("0x00FF - HIGH\n");
+}
+
+/*
+
+Fx30 - LD HF, Vx
+Set I = location of the 10 byte sprite for digit Vx.
+
+*/
+
+static inline void op_ld_hf (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	m->I = FONT_HIRES + (10 * m->V[in->x]);
+
+	//printf("0xF%X30 - LD HF, V%X\n", in->x, in->x);
+}
+
+/*
+
+Fx75 - LD R, Vx
+Store registers V0 through Vx in the user flags.
+
+*/
+
+static inline void op_ld_r (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	memcpy(m->flags, m->V, in->x + 1);
+
+	//printf("0xF%X75 - LD R, V%X\n", in->x, in->x);
+}
+
+/*
+
+Fx85 - LD Vx, R
+Read registers V0 through Vx from the user flags.
+
+*/
+
+static inline void op_ld_vx_r (Machine *m, Instr *in)
+{
+	m->PC++;
+
+	memcpy(m->V, m->flags, in->x + 1);
+
+	//printf("0xF%X85 - LD V%X, R\n", in->x, in->x);
+}
+
+/*
+
+Anything else inside the 8, E and F groups does nothing, not even move PC.
+
+*/
+
+static inline void op_none (Machine *m, Instr *in)
+{
+}
+
+#endif
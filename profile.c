@@ -0,0 +1,118 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "profile.h"
+
+// Without -DPROFILE nothing is counted, not even the tables are kept
+
+#ifdef PROFILE
+
+#include "disasm.h"
+#include "ops.h"
+
+typedef struct Counter
+{
+	u64 count;
+	u64 cycles;
+} Counter;
+
+static Counter by_op[OP_COUNT];
+static Counter by_address[4096];
+
+void profile_count (u16 address, u16 ir, u64 cycles)
+{
+	Instr in;
+	
+	instr_decode(&in, ir);
+	by_op[in.op].count++;
+	by_op[in.op].cycles += cycles;
+	by_address[address & 0xFFF].count++;
+	by_address[address & 0xFFF].cycles += cycles;
+}
+
+static const Counter *sort_table;
+
+static int by_cycles (const void *a, const void *b)
+{
+	// Most cycles first, then the lowest index
+	
+	const Counter *x = &sort_table[*(const u16 *)a];
+	const Counter *y = &sort_table[*(const u16 *)b];
+	
+	if (x->cycles != y->cycles)
+	{
+		return x->cycles < y->cycles ? 1 : -1;
+	}
+	return *(const u16 *)a - *(const u16 *)b;
+}
+
+static void sort_counters (const Counter *table, u16 *order, int size)
+{
+	int i;
+	
+	for (i = 0; i < size; i++)
+	{
+		order[i] = i;
+	}
+	sort_table = table;
+	qsort(order, size, sizeof(order[0]), by_cycles);
+}
+
+void profile_report (Machine *m, FILE *out)
+{
+	u16 order[4096];
+	u64 count = 0, cycles = 0;
+	char text[DISASM_MAX];
+	u16 address, ir;
+	int i;
+	
+	for (i = 0; i < OP_COUNT; i++)
+	{
+		count += by_op[i].count;
+		cycles += by_op[i].cycles;
+	}
+	if (count == 0)
+	{
+		fprintf(out, "Profile: no instructions run\n");
+		return;
+	}
+	fprintf(out, "Profile: %llu instructions, %llu cycles, %.1f cycles each\n",
+		(unsigned long long)count, (unsigned long long)cycles, (double)cycles / count);
+	
+	fprintf(out, "\n%-12s %12s %7s %14s %7s %8s\n", "instruction", "count", "%", "cycles", "%", "each");
+	sort_counters(by_op, order, OP_COUNT);
+	for (i = 0; i < OP_COUNT && by_op[order[i]].count > 0; i++)
+	{
+		fprintf(out, "%-12s %12llu %6.2f%% %14llu %6.2f%% %8.1f\n", disasm_op(order[i]),
+			(unsigned long long)by_op[order[i]].count, 100.0 * by_op[order[i]].count / count,
+			(unsigned long long)by_op[order[i]].cycles, 100.0 * by_op[order[i]].cycles / cycles,
+			(double)by_op[order[i]].cycles / by_op[order[i]].count);
+	}
+	
+	// The instruction there now, code that changes itself may have run others
+	fprintf(out, "\n%-7s %-4s %-18s %12s %7s %14s %7s %8s\n", "address", "ir", "", "count", "%", "cycles", "%", "each");
+	sort_counters(by_address, order, 4096);
+	for (i = 0; i < PROFILE_TOP && by_address[order[i]].count > 0; i++)
+	{
+		address = order[i];
+		ir = m->memory[address] << 8 | m->memory[(address + 1) & 0xFFF];
+		disasm(ir, text);
+		fprintf(out, "0x%03X   %04X %-18s %12llu %6.2f%% %14llu %6.2f%% %8.1f\n", address, ir, text,
+			(unsigned long long)by_address[address].count, 100.0 * by_address[address].count / count,
+			(unsigned long long)by_address[address].cycles, 100.0 * by_address[address].cycles / cycles,
+			(double)by_address[address].cycles / by_address[address].count);
+	}
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include "machine.h"
+
+/*
+
+Profiler
+
+Built with -DPROFILE, every instruction run is counted, with the host cycles
+it took (rdtsc, or nanoseconds where there is no rdtsc), by kind of
+instruction (OP_* in ops.h) and by the address it was fetched from. At the
+end profile_report prints both, the hottest first, with the instruction at
+every address, to find the loops a ROM spends its time in.
+
+The count is done around instruction_execute, so a profiling build runs the
+switch engine whatever engine is asked for. Loops worked out at once by
+machine_idle are not run and so not counted, add -DNO_IDLE_LOOPS to see
+them. Without -DPROFILE nothing of this is in the machine, and profile.c
+is left empty.
+
+Counts are for the whole process, of every machine in it.
+
+*/
+
+// Addresses shown in the report
+
+#define PROFILE_TOP 32
+
+#ifdef PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static inline u64 profile_clock (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (u64)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+#endif
+
+void profile_count (u16 address, u16 ir, u64 cycles);
+void profile_report (Machine *m, FILE *out);
+
+#endif
@@ -0,0 +1,204 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "rewind.h"
+
+// Longest a delta can get, every byte in its own run
+
+#define DELTA_MAX (sizeof(State) * 5 + 4)
+
+// Zeros shorter than this do not end a run of bytes
+
+#define DELTA_GAP 4
+
+int rewind_init (Rewind *r, size_t size, unsigned int every)
+{
+	memset(r, 0, sizeof(*r));
+	r->ring = malloc(size);
+	r->delta = malloc(DELTA_MAX);
+	if (r->ring == NULL || r->delta == NULL)
+	{
+		rewind_free(r);
+		return 0;
+	}
+	r->size = size;
+	r->every = every > 0 ? every : 1;
+	return 1;
+}
+
+void rewind_free (Rewind *r)
+{
+	free(r->ring);
+	free(r->delta);
+	r->ring = NULL;
+	r->delta = NULL;
+}
+
+// Copy in and out of the ring, going round at the end
+
+static void ring_put (Rewind *r, size_t at, const void *data, size_t n)
+{
+	size_t first;
+	
+	at %= r->size;
+	first = (n < r->size - at) ? n : r->size - at;
+	memcpy(r->ring + at, data, first);
+	memcpy(r->ring, (const u8 *) data + first, n - first);
+}
+
+static void ring_get (Rewind *r, size_t at, void *data, size_t n)
+{
+	size_t first;
+	
+	at %= r->size;
+	first = (n < r->size - at) ? n : r->size - at;
+	memcpy(data, r->ring + at, first);
+	memcpy((u8 *) data + first, r->ring, n - first);
+}
+
+static size_t delta_encode (const u8 *a, const u8 *b, size_t n, u8 *out)
+{
+	size_t i = 0, zeros, start, end, gap, length = 0;
+	
+	while (i < n)
+	{
+		// Whole words first, then byte by byte
+		zeros = 0;
+		while (i + 8 <= n && zeros + 8 <= 0xFFFF && memcmp(a + i, b + i, 8) == 0)
+		{
+			i += 8;
+			zeros += 8;
+		}
+		while (i < n && a[i] == b[i] && zeros < 0xFFFF)
+		{
+			i++;
+			zeros++;
+		}
+		
+		// Bytes until DELTA_GAP of them are the same
+		start = i;
+		end = i;
+		gap = 0;
+		while (i < n && gap < DELTA_GAP && end - start < 0xFFFF)
+		{
+			if (a[i] != b[i])
+			{
+				end = i + 1;
+				gap = 0;
+			}
+			else
+			{
+				gap++;
+			}
+			i++;
+		}
+		i = end;
+		
+		out[length++] = zeros & 0xFF;
+		out[length++] = zeros >> 8;
+		out[length++] = (end - start) & 0xFF;
+		out[length++] = (end - start) >> 8;
+		for (; start < end; start++)
+		{
+			out[length++] = a[start] ^ b[start];
+		}
+	}
+	return length;
+}
+
+static void delta_apply (u8 *a, size_t n, const u8 *in, size_t length)
+{
+	size_t i = 0, at = 0, zeros, bytes;
+	
+	while (at < length && i <= n)
+	{
+		zeros = in[at] | in[at + 1] << 8;
+		bytes = in[at + 2] | in[at + 3] << 8;
+		at += 4;
+		i += zeros;
+		for (; bytes > 0 && i < n; bytes--)
+		{
+			a[i++] ^= in[at++];
+		}
+	}
+}
+
+static void drop_oldest (Rewind *r)
+{
+	u32 length;
+	
+	ring_get(r, r->head + r->size - r->used, &length, 4);
+	r->used -= length + 8;
+	r->count--;
+}
+
+void rewind_frame (Rewind *r, Machine *m)
+{
+	// After every frame, keeps a state when its turn comes
+	
+	u32 length;
+	
+	if (m->frame % r->every != 0)
+	{
+		return;
+	}
+	state_capture(m, &r->next);
+	if (r->have)
+	{
+		length = delta_encode((u8 *) &r->next, (u8 *) &r->last, sizeof(State), r->delta);
+		if (length + 8 > r->size)
+		{
+			// Does not fit even alone, the history starts again here
+			r->used = 0;
+			r->count = 0;
+		}
+		else
+		{
+			while (r->used + length + 8 > r->size)
+			{
+				drop_oldest(r);
+			}
+			ring_put(r, r->head, &length, 4);
+			ring_put(r, r->head + 4, r->delta, length);
+			ring_put(r, r->head + 4 + length, &length, 4);
+			r->head = (r->head + length + 8) % r->size;
+			r->used += length + 8;
+			r->count++;
+		}
+	}
+	memcpy(&r->last, &r->next, sizeof(State));
+	r->have = 1;
+}
+
+int rewind_back (Rewind *r, Machine *m)
+{
+	// Back to the state before the newest, 0 when there is none
+	
+	u32 length;
+	size_t start;
+	
+	if (r->count == 0)
+	{
+		return 0;
+	}
+	ring_get(r, r->head + r->size - 4, &length, 4);
+	start = r->head + r->size - 4 - length;
+	ring_get(r, start, r->delta, length);
+	delta_apply((u8 *) &r->last, sizeof(State), r->delta, length);
+	r->head = (start + r->size - 4) % r->size;
+	r->used -= length + 8;
+	r->count--;
+	state_restore(m, &r->last);
+	return 1;
+}
@@ -0,0 +1,50 @@
+#ifndef _REWIND_H
+#define _REWIND_H
+
+#include "state.h"
+
+/*
+
+Rewind
+
+Every few frames the state of the machine is kept, so the game can be
+stepped back. Only the newest state is kept whole, before it goes into
+a ring of bytes as the XOR against the one before. Most of it does not
+change between frames, so that is mostly zeros and is stored as runs of
+zeros and literal bytes:
+
+	zeros, length	2 bytes each
+	bytes		length of them, XOR of the two states
+
+repeated until the whole state is covered. Every delta has its size
+before and after it, so the oldest can be dropped when the ring is full
+and the newest taken back when stepping back.
+
+*/
+
+typedef struct Rewind
+{
+	u8 *ring;
+	size_t size;
+
+	// Where the next delta goes, bytes in use and deltas held
+	size_t head;
+	size_t used;
+	unsigned long count;
+
+	// Keep a state every this many frames
+	unsigned int every;
+
+	// Newest state, and room to take the next one and encode it
+	u8 have;
+	State last;
+	State next;
+	u8 *delta;
+} Rewind;
+
+int rewind_init (Rewind *r, size_t size, unsigned int every);
+void rewind_free (Rewind *r);
+void rewind_frame (Rewind *r, Machine *m);
+int rewind_back (Rewind *r, Machine *m);
+
+#endif
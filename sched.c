@@ -0,0 +1,92 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "sched.h"
+
+double sched_now (void)
+{
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void sched_init (Scheduler *s, u8 throttle)
+{
+	memset(s, 0, sizeof(*s));
+	s->throttle = throttle;
+	s->start = sched_now();
+	s->next = s->start + 1.0 / FRAME_RATE;
+}
+
+void sched_frame (Scheduler *s)
+{
+	// A frame is done, wait until the next one is due
+	
+	double now = sched_now(), wait;
+	struct timespec t;
+	
+	s->frames++;
+	if (!s->throttle)
+	{
+		return;
+	}
+	
+	wait = s->next - now;
+	if (wait > 0)
+	{
+		t.tv_sec = (time_t) wait;
+		t.tv_nsec = (long) ((wait - t.tv_sec) * 1e9);
+		while (nanosleep(&t, &t) != 0)
+		{
+			// Interrupted, sleep what is left
+		}
+	}
+	else
+	{
+		s->late++;
+		if (-wait > s->worst)
+		{
+			s->worst = -wait;
+		}
+		if (-wait > SCHED_MAX_LATE)
+		{
+			s->next = now;
+			s->resyncs++;
+		}
+	}
+	s->next += 1.0 / FRAME_RATE;
+}
+
+void sched_resync (Scheduler *s)
+{
+	// After sleeping on purpose, the next frame is due a frame from now
+	
+	s->next = sched_now() + 1.0 / FRAME_RATE;
+}
+
+void sched_report (Scheduler *s, FILE *out)
+{
+	// Drift is how far the frames run behind (+) or ahead (-) of the wall clock
+	
+	double elapsed = sched_now() - s->start;
+	
+	fprintf(out, "%lu frames in %.3f s, %.2f frames/s", s->frames, elapsed, s->frames / elapsed);
+	if (s->throttle)
+	{
+		fprintf(out, ", drift %+.1f ms, %lu late (worst %.1f ms), %lu resyncs",
+			(elapsed - (double) s->frames / FRAME_RATE) * 1000, s->late, s->worst * 1000, s->resyncs);
+	}
+	fprintf(out, "\n");
+}
@@ -0,0 +1,45 @@
+#ifndef _SCHED_H
+#define _SCHED_H
+
+#include "machine.h"
+
+/*
+
+Scheduler
+
+Keeps the frames, and so the timers, at 60 a second of real time whatever
+the speed of the host, sleeping in between. Every frame is due at a fixed
+time from the start, so small delays do not add up. When it falls too far
+behind it gives up catching up and starts counting from now again.
+Unthrottled it never sleeps, for batch runs.
+
+*/
+
+#define FRAME_RATE 60
+
+// Further behind than this and the lost frames are not made up
+
+#define SCHED_MAX_LATE 0.25
+
+typedef struct Scheduler
+{
+	u8 throttle;
+
+	// Seconds on the monotonic clock, when frame 0 started and when the next one is due
+	double start;
+	double next;
+	unsigned long frames;
+
+	// Frames that started late, the worst of them, and times it gave up
+	unsigned long late;
+	double worst;
+	unsigned long resyncs;
+} Scheduler;
+
+double sched_now (void);
+void sched_init (Scheduler *s, u8 throttle);
+void sched_frame (Scheduler *s);
+void sched_resync (Scheduler *s);
+void sched_report (Scheduler *s, FILE *out);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "screen.h"
+
+// Window surface, one per process
+
+static SDL_Surface *scr;
+
+// Mode the window is sized for, 1 for the 128 x 64 one
+
+static u8 shown;
+
+// Window of the size of the screen in a mode, the same SCALE in both
+
+static int screen_open (u8 hires)
+{
+	SDL_Color palette[] =
+	{
+		{0, 0, 0, 0},
+		{255, 255, 255, 255}
+	};
+	
+	scr = SDL_SetVideoMode(((hires ? X_HIRES : X_MAX) * SCALE), ((hires ? Y_HIRES : Y_MAX) * SCALE), 8, SDL_SWSURFACE);
+	if (scr == NULL)
+	{
+		return 0;
+	}
+	SDL_SetPalette(scr, SDL_LOGPAL|SDL_PHYSPAL, palette, 0, 2);
+	shown = hires;
+	return 1;
+}
+
+int screen_init()
+{
+	SDL_Init(SDL_INIT_VIDEO);
+	if (!screen_open(0))
+	{
+		return 0;
+	}
+	SDL_WM_SetCaption("Another chip-8 emulator", 0);
+	return 1;
+}
+
+void screen_render(Machine *m)
+{
+	// Copy the lines of Display that changed straight to the window pixels
+	
+	u8 x, y, s, top, bottom = 0;
+	u8 *line, *p;
+	
+	// 00FE and 00FF resize the window, and all of it is drawn again
+	if (m->hires != shown)
+	{
+		if (!screen_open(m->hires))
+		{
+			return;
+		}
+		m->dirty = ALL_LINES(m);
+	}
+	top = LINES(m);
+	
+	if (SDL_MUSTLOCK(scr) && SDL_LockSurface(scr) < 0)
+	{
+		return;
+	}
+	for (y = 0; y < LINES(m); y++)
+	{
+		if (!((m->dirty >> y) & 1))
+		{
+			continue;
+		}
+		
+		// One scaled line of pixels, then copied down SCALE - 1 times
+		line = (u8 *) scr->pixels + y * SCALE * scr->pitch;
+		p = line;
+		for (x = 0; x < COLUMNS(m); x++)
+		{
+			memset(p, (int) PIXEL(m, x, y), SCALE);
+			p += SCALE;
+		}
+		for (s = 1; s < SCALE; s++)
+		{
+			memcpy(line + s * scr->pitch, line, COLUMNS(m) * SCALE);
+		}
+		
+		if (y < top)
+		{
+			top = y;
+		}
+		bottom = y;
+	}
+	if (SDL_MUSTLOCK(scr))
+	{
+		SDL_UnlockSurface(scr);
+	}
+	
+	// Only the band of lines that changed goes to the screen
+	if (top <= bottom)
+	{
+		SDL_UpdateRect(scr, 0, top * SCALE, COLUMNS(m) * SCALE, (bottom - top + 1) * SCALE);
+	}
+	m->dirty = 0;
+}
+
+/*
+
+KEYBOARD CHIP-8
+
+_________
+|1|2|3|C|
+---------
+|4|5|6|D|
+---------
+|7|8|9|E|
+---------
+|A|0|B|F|
+---------
+
+Host key for every Chip-8 key, from 0 to F
+
+*/
+
+static const SDLKey keymap[16] =
+{
+	SDLK_x,	// 0
+	SDLK_1,	// 1
+	SDLK_2,	// 2
+	SDLK_3,	// 3
+	SDLK_q,	// 4
+	SDLK_w,	// 5
+	SDLK_e,	// 6
+	SDLK_a,	// 7
+	SDLK_s,	// 8
+	SDLK_d,	// 9
+	SDLK_z,	// A
+	SDLK_c,	// B
+	SDLK_4,	// C
+	SDLK_r,	// D
+	SDLK_f,	// E
+	SDLK_v	// F
+};
+
+int screen_poll(u16 *keys, u8 *back)
+{
+	// Drain the events once per frame, returns 0 when the user wants to quit
+	// back is set while Backspace is held down
+	
+	SDL_Event Events;
+	int running = 1;
+	u8 key;
+	
+	while (SDL_PollEvent(&Events))
+	{
+		switch(Events.type)
+		{
+			case SDL_QUIT:
+				running = 0;
+				break;
+			case SDL_KEYDOWN:
+			case SDL_KEYUP:
+				if (Events.key.keysym.sym == SDLK_ESCAPE)
+				{
+					running = 0;
+				}
+				if (Events.key.keysym.sym == SDLK_BACKSPACE)
+				{
+					*back = (Events.type == SDL_KEYDOWN);
+				}
+				for (key = 0; key < 16; key++)
+				{
+					if (Events.key.keysym.sym == keymap[key])
+					{
+						if (Events.type == SDL_KEYDOWN)
+						{
+							*keys |= 1 << key;
+						}
+						else
+						{
+							*keys &= ~(1 << key);
+						}
+					}
+				}
+				break;
+		}
+	}
+	return running;
+}
+
+int screen_wait(u16 *keys, u8 *back)
+{
+	// Sleep until there is an event, then read them as screen_poll
+	
+	SDL_WaitEvent(NULL);
+	return screen_poll(keys, back);
+}
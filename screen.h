@@ -0,0 +1,12 @@
+#ifndef _SCREEN_H
+#define _SCREEN_H
+
+#include "SDL/SDL.h"
+#include "machine.h"
+
+int screen_init ();
+void screen_render (Machine *m);
+int screen_poll (u16 *keys, u8 *back);
+int screen_wait (u16 *keys, u8 *back);
+
+#endif
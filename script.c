@@ -0,0 +1,130 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "script.h"
+#include <limits.h>
+
+static int script_next(Script *s)
+{
+	// Read the next "frame keys" line, 0 at the end of the file
+	
+	char line[128];
+	unsigned long frame;
+	unsigned int keys, seed;
+	
+	while (fgets(line, sizeof(line), s->file) != NULL)
+	{
+		if (line[0] == '#')
+		{
+			continue;
+		}
+		if (sscanf(line, "seed %x", &seed) == 1)
+		{
+			s->seed = seed;
+			s->has_seed = 1;
+			continue;
+		}
+		if (sscanf(line, "%lu %x", &frame, &keys) == 2)
+		{
+			s->next_frame = frame;
+			s->next_keys = keys;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int script_open(Script *s, char *file_name)
+{
+	s->keys = 0;
+	s->has_seed = 0;
+	s->file = fopen(file_name, "r");
+	if (s->file == NULL)
+	{
+		return 0;
+	}
+	if (!script_next(s))
+	{
+		fclose(s->file);
+		s->file = NULL;
+	}
+	return 1;
+}
+
+void script_close(Script *s)
+{
+	if (s->file != NULL)
+	{
+		fclose(s->file);
+		s->file = NULL;
+	}
+}
+
+u16 script_keys(Script *s, unsigned long frame)
+{
+	// Keys held down at this frame
+	
+	while (s->file != NULL && s->next_frame <= frame)
+	{
+		s->keys = s->next_keys;
+		if (!script_next(s))
+		{
+			script_close(s);
+		}
+	}
+	return s->keys;
+}
+
+unsigned long script_next_change(Script *s)
+{
+	// Frame of the next line, the keys stay as they are until then
+	
+	if (s->file == NULL)
+	{
+		return ULONG_MAX;
+	}
+	return s->next_frame;
+}
+
+int record_open(Record *r, char *file_name, u32 seed)
+{
+	r->keys = 0;
+	r->file = fopen(file_name, "w");
+	if (r->file == NULL)
+	{
+		return 0;
+	}
+	fprintf(r->file, "seed %08x\n", seed);
+	return 1;
+}
+
+void record_keys(Record *r, unsigned long frame, u16 keys)
+{
+	// Only the changes, nothing is held at the start
+	
+	if (keys != r->keys)
+	{
+		fprintf(r->file, "%lu %04x\n", frame, keys);
+		r->keys = keys;
+	}
+}
+
+void record_close(Record *r)
+{
+	if (r->file != NULL)
+	{
+		fclose(r->file);
+		r->file = NULL;
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef _SCRIPT_H
+#define _SCRIPT_H
+
+#include "machine.h"
+
+/*
+
+Scripted input
+
+A text file with one "frame keys" pair per line, both numbers, keys in hex.
+From that frame on the keys set in the 16 bits mask are held down,
+bit 0 is key 0 up to bit 15 for key F. Lines starting with # are ignored.
+A "seed" line gives the seed for random numbers, in hex.
+
+	# press 5 after one second, release it a bit later
+	seed 1234abcd
+	60 0020
+	75 0000
+
+A recording is a script too, written while playing: the seed and a line
+every time the keys change, so playing it back does the same run again.
+
+*/
+
+typedef struct Script
+{
+	FILE *file;
+	unsigned long next_frame;
+	u16 next_keys;
+	u16 keys;
+	u8 has_seed;
+	u32 seed;
+} Script;
+
+typedef struct Record
+{
+	FILE *file;
+	u16 keys;
+} Record;
+
+int script_open (Script *s, char *file_name);
+void script_close (Script *s);
+u16 script_keys (Script *s, unsigned long frame);
+unsigned long script_next_change (Script *s);
+int record_open (Record *r, char *file_name, u32 seed);
+void record_keys (Record *r, unsigned long frame, u16 keys);
+void record_close (Record *r);
+
+#endif
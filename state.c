@@ -0,0 +1,295 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "state.h"
+#include "ops.h"
+
+// Runs closer than this are written as one, a run costs 4 bytes
+
+#define STATE_GAP 4
+
+void state_capture (Machine *m, State *s)
+{
+	s->rom = m->rom;
+	memcpy(s->memory, m->memory, sizeof(s->memory));
+	memcpy(s->V, m->V, sizeof(s->V));
+	s->I = m->I;
+	s->IR = m->IR;
+	s->PC = m->PC;
+	memcpy(s->stack, m->stack, sizeof(s->stack));
+	s->SP = m->SP;
+	s->DT = m->DT;
+	s->ST = m->ST;
+	s->frame = m->frame;
+	s->keys = m->keys;
+	s->waiting = m->waiting;
+	s->rng = m->rng;
+	s->hires = m->hires;
+	memcpy(s->flags, m->flags, sizeof(s->flags));
+	memcpy(s->Display, m->Display, sizeof(s->Display));
+}
+
+void state_restore (Machine *m, const State *s)
+{
+	// Memory is compared 8 bytes at a time, only bytes that changed go through mem_write
+	
+	u16 i, b;
+	
+	for (i = 0; i < sizeof(m->memory); i += 8)
+	{
+		if (memcmp(&m->memory[i], &s->memory[i], 8) != 0)
+		{
+			for (b = i; b < i + 8; b++)
+			{
+				if (m->memory[b] != s->memory[b])
+				{
+					mem_write(m, b, s->memory[b]);
+				}
+			}
+		}
+	}
+	memcpy(m->V, s->V, sizeof(m->V));
+	m->I = s->I;
+	m->IR = s->IR;
+	m->PC = s->PC;
+	memcpy(m->stack, s->stack, sizeof(m->stack));
+	m->SP = s->SP;
+	m->DT = s->DT;
+	m->ST = s->ST;
+	m->frame = s->frame;
+	m->keys = s->keys;
+	m->waiting = s->waiting;
+	m->rng = s->rng;
+	m->hires = s->hires;
+	memcpy(m->flags, s->flags, sizeof(m->flags));
+	memcpy(m->Display, s->Display, sizeof(m->Display));
+	m->dirty = ALL_LINES(m);
+}
+
+static void put (FILE *file, unsigned long long value, int bytes)
+{
+	while (bytes-- > 0)
+	{
+		fputc(value & 0xFF, file);
+		value >>= 8;
+	}
+}
+
+static unsigned long long get (FILE *file, int bytes)
+{
+	unsigned long long value = 0;
+	int i, c;
+	
+	for (i = 0; i < bytes; i++)
+	{
+		c = fgetc(file);
+		value |= (unsigned long long) (c & 0xFF) << (8 * i);
+	}
+	return value;
+}
+
+int state_write (const State *s, const u8 *base, FILE *file)
+{
+	// base is memory as the game was loaded, NULL to write all of it
+	
+	int i, start, end;
+	
+	fwrite(STATE_MAGIC, 1, 4, file);
+	put(file, STATE_VERSION, 1);
+	put(file, base != NULL ? STATE_DELTA : 0, 1);
+	put(file, s->rom, 4);
+	fwrite(s->V, 1, 16, file);
+	put(file, s->I, 2);
+	put(file, s->IR, 2);
+	put(file, s->PC, 2);
+	put(file, s->SP, 1);
+	for (i = 0; i < 16; i++)
+	{
+		put(file, s->stack[i], 2);
+	}
+	put(file, s->DT, 2);
+	put(file, s->ST, 2);
+	put(file, s->frame, 8);
+	put(file, s->keys, 2);
+	put(file, s->waiting, 1);
+	put(file, s->rng, 4);
+	put(file, s->hires, 1);
+	fwrite(s->flags, 1, 16, file);
+	for (i = 0; i < LINES(s); i++)
+	{
+		put(file, s->Display[i][0], 8);
+		if (s->hires)
+		{
+			put(file, s->Display[i][1], 8);
+		}
+	}
+	
+	if (base == NULL)
+	{
+		fwrite(s->memory, 1, 4096, file);
+	}
+	else
+	{
+		start = 0;
+		while (start < 4096)
+		{
+			if (s->memory[start] == base[start])
+			{
+				start++;
+				continue;
+			}
+			
+			// Stretch the run while the next change is close
+			end = start + 1;
+			for (i = end; i < 4096 && i < end + STATE_GAP; i++)
+			{
+				if (s->memory[i] != base[i])
+				{
+					end = i + 1;
+				}
+			}
+			put(file, start, 2);
+			put(file, end - start, 2);
+			fwrite(&s->memory[start], 1, end - start, file);
+			start = end;
+		}
+		put(file, 0, 2);
+		put(file, 0, 2);
+	}
+	return !ferror(file);
+}
+
+int state_read (State *s, const u8 *base, FILE *file)
+{
+	// base has to be the same memory the state was written against
+	
+	char magic[4];
+	u8 version, flags;
+	u16 offset, length;
+	int i;
+	
+	if (fread(magic, 1, 4, file) != 4 || memcmp(magic, STATE_MAGIC, 4) != 0)
+	{
+		return 0;
+	}
+	version = get(file, 1);
+	if (version < 1 || version > STATE_VERSION)
+	{
+		return 0;
+	}
+	flags = get(file, 1);
+	s->rom = get(file, 4);
+	if (fread(s->V, 1, 16, file) != 16)
+	{
+		return 0;
+	}
+	s->I = get(file, 2);
+	s->IR = get(file, 2);
+	s->PC = get(file, 2);
+	s->SP = get(file, 1);
+	for (i = 0; i < 16; i++)
+	{
+		s->stack[i] = get(file, 2);
+	}
+	s->DT = get(file, 2);
+	s->ST = get(file, 2);
+	s->frame = get(file, 8);
+	s->keys = get(file, 2);
+	s->waiting = get(file, 1);
+	
+	// Version 1 had rand(), any seed will do
+	s->rng = (version >= 2) ? get(file, 4) : 1;
+	
+	// Before version 3 there was only low resolution
+	memset(s->flags, 0, sizeof(s->flags));
+	memset(s->Display, 0, sizeof(s->Display));
+	s->hires = (version >= 3) ? get(file, 1) != 0 : 0;
+	if (version >= 3 && fread(s->flags, 1, 16, file) != 16)
+	{
+		return 0;
+	}
+	for (i = 0; i < LINES(s); i++)
+	{
+		s->Display[i][0] = get(file, 8);
+		if (s->hires)
+		{
+			s->Display[i][1] = get(file, 8);
+		}
+	}
+	
+	if (!(flags & STATE_DELTA))
+	{
+		return fread(s->memory, 1, 4096, file) == 4096;
+	}
+	if (base == NULL)
+	{
+		return 0;
+	}
+	memcpy(s->memory, base, 4096);
+	for (;;)
+	{
+		offset = get(file, 2);
+		length = get(file, 2);
+		if (feof(file) || offset + length > 4096)
+		{
+			return 0;
+		}
+		if (length == 0)
+		{
+			return 1;
+		}
+		if (fread(&s->memory[offset], 1, length, file) != length)
+		{
+			return 0;
+		}
+	}
+}
+
+int state_save (Machine *m, const u8 *base, char *file_name)
+{
+	State s;
+	FILE *file;
+	int ok;
+	
+	file = fopen(file_name, "wb");
+	if (file == NULL)
+	{
+		return 0;
+	}
+	state_capture(m, &s);
+	ok = state_write(&s, base, file);
+	return (fclose(file) == 0) && ok;
+}
+
+int state_load (Machine *m, const u8 *base, char *file_name)
+{
+	// Only for the game that is loaded, a delta means nothing on another one
+	
+	State s;
+	FILE *file;
+	int ok;
+	
+	file = fopen(file_name, "rb");
+	if (file == NULL)
+	{
+		return 0;
+	}
+	ok = state_read(&s, base, file) && s.rom == m->rom;
+	fclose(file);
+	if (ok)
+	{
+		state_restore(m, &s);
+	}
+	return ok;
+}
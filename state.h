@@ -0,0 +1,72 @@
+#ifndef _STATE_H
+#define _STATE_H
+
+#include "machine.h"
+
+/*
+
+Machine state
+
+A State is everything a running machine is, so it can be put back later
+as many times as wanted. Decoded and translated code is left out, restoring
+only throws away what was over memory that changed.
+
+On disk, all numbers little endian:
+
+	"C8ST"			magic
+	version			1 byte, STATE_VERSION
+	flags			1 byte, STATE_DELTA if memory is a delta
+	rom			4 bytes, hash of the game
+	V0 to VF		16 bytes
+	I, IR, PC		2 bytes each
+	SP			1 byte
+	stack			16 x 2 bytes
+	DT, ST			2 bytes each
+	frame			8 bytes
+	keys			2 bytes
+	waiting			1 byte
+	rng			4 bytes, not in version 1
+	hires			1 byte, 1 in the 128 x 64 mode, not before version 3
+	flags			16 bytes, user flags, not before version 3
+	Display			Y_MAX x 8 bytes, one line each, or with
+				hires Y_HIRES x 16 bytes, two words a line
+	memory			4096 bytes, or with STATE_DELTA the runs that
+				are not as the game was loaded: offset and
+				length, 2 bytes each, then the bytes; a
+				length of 0 ends it
+
+*/
+
+#define STATE_MAGIC "C8ST"
+#define STATE_VERSION 3
+#define STATE_DELTA 1
+
+typedef struct State
+{
+	unsigned long rom;
+	u8 memory[4096];
+	u8 V[16];
+	u16 I;
+	u16 IR;
+	u16 PC;
+	u16 stack[16];
+	u8 SP;
+	u16 DT;
+	u16 ST;
+	unsigned long frame;
+	u16 keys;
+	u8 waiting;
+	u32 rng;
+	u8 hires;
+	u8 flags[16];
+	u64 Display[Y_HIRES][2];
+} State;
+
+void state_capture (Machine *m, State *s);
+void state_restore (Machine *m, const State *s);
+int state_write (const State *s, const u8 *base, FILE *file);
+int state_read (State *s, const u8 *base, FILE *file);
+int state_save (Machine *m, const u8 *base, char *file_name);
+int state_load (Machine *m, const u8 *base, char *file_name);
+
+#endif
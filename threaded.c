@@ -0,0 +1,392 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "ops.h"
+
+/*
+
+Threaded engine
+
+Every decoded instruction keeps in target where its code starts, so going
+to the next instruction is a single indirect jump at the end of each one
+instead of the shared jump of a switch. This needs the labels as values
+extension of GCC; build with -DNO_COMPUTED_GOTO, or with another compiler,
+to get a table of functions indexed by the opcode id instead.
+
+A function with computed gotos is never inlined, so it can not be built
+once per set of quirks as the others are. The quirks are looked at when
+an instruction is decoded instead: the ones that depend on them get the
+code for what the machine asks, a label of their own, and never ask again.
+
+*/
+
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+
+// Leave when the budget is spent, odd addresses go the slow way
+
+#define NEXT() \
+	m->IR = in->ir; \
+	while (left > 0 && (m->PC & 1)) \
+	{ \
+		machine_step(m); \
+		left--; \
+	} \
+	if (left == 0) \
+	{ \
+		return; \
+	} \
+	left--; \
+	address = m->PC & 0xFFF; \
+	in = &m->code[address >> 1]; \
+	m->PC++; \
+	goto *(&&do_decode + in->target)
+
+void threaded_run (Machine *m, unsigned int left)
+{
+	static const int targets[OP_COUNT] =
+	{
+		[OP_DECODE] = 0,
+		[OP_CLS] = &&do_cls - &&do_decode,
+		[OP_RET] = &&do_ret - &&do_decode,
+		[OP_SYS] = &&do_sys - &&do_decode,
+		[OP_JP] = &&do_jp - &&do_decode,
+		[OP_CALL] = &&do_call - &&do_decode,
+		[OP_SE_BYTE] = &&do_se_byte - &&do_decode,
+		[OP_SNE_BYTE] = &&do_sne_byte - &&do_decode,
+		[OP_SE_REG] = &&do_se_reg - &&do_decode,
+		[OP_LD_BYTE] = &&do_ld_byte - &&do_decode,
+		[OP_ADD_BYTE] = &&do_add_byte - &&do_decode,
+		[OP_LD_REG] = &&do_ld_reg - &&do_decode,
+		[OP_OR] = &&do_or - &&do_decode,
+		[OP_AND] = &&do_and - &&do_decode,
+		[OP_XOR] = &&do_xor - &&do_decode,
+		[OP_ADD_REG] = &&do_add_reg - &&do_decode,
+		[OP_SUB] = &&do_sub - &&do_decode,
+		[OP_SHR] = &&do_shr - &&do_decode,
+		[OP_SUBN] = &&do_subn - &&do_decode,
+		[OP_SHL] = &&do_shl - &&do_decode,
+		[OP_SNE_REG] = &&do_sne_reg - &&do_decode,
+		[OP_LD_I] = &&do_ld_i - &&do_decode,
+		[OP_JP_V0] = &&do_jp_v0 - &&do_decode,
+		[OP_RND] = &&do_rnd - &&do_decode,
+		[OP_DRW] = &&do_drw - &&do_decode,
+		[OP_SKP] = &&do_skp - &&do_decode,
+		[OP_SKNP] = &&do_sknp - &&do_decode,
+		[OP_LD_VX_DT] = &&do_ld_vx_dt - &&do_decode,
+		[OP_LD_KEY] = &&do_ld_key - &&do_decode,
+		[OP_LD_DT] = &&do_ld_dt - &&do_decode,
+		[OP_LD_ST] = &&do_ld_st - &&do_decode,
+		[OP_ADD_I] = &&do_add_i - &&do_decode,
+		[OP_LD_F] = &&do_ld_f - &&do_decode,
+		[OP_LD_B] = &&do_ld_b - &&do_decode,
+		[OP_LD_MEM] = &&do_ld_mem - &&do_decode,
+		[OP_LD_REG_MEM] = &&do_ld_reg_mem - &&do_decode,
+		[OP_SCD] = &&do_scd - &&do_decode,
+		[OP_SCR] = &&do_scr - &&do_decode,
+		[OP_SCL] = &&do_scl - &&do_decode,
+		[OP_EXIT] = &&do_exit - &&do_decode,
+		[OP_LOW] = &&do_low - &&do_decode,
+		[OP_HIGH] = &&do_high - &&do_decode,
+		[OP_LD_HF] = &&do_ld_hf - &&do_decode,
+		[OP_LD_R] = &&do_ld_r - &&do_decode,
+		[OP_LD_VX_R] = &&do_ld_vx_r - &&do_decode,
+		[OP_NONE] = &&do_none - &&do_decode,
+	};
+	static const int quirked[OP_COUNT] =
+	{
+		[OP_SHR] = &&do_shr_vy - &&do_decode,
+		[OP_SHL] = &&do_shl_vy - &&do_decode,
+		[OP_JP_V0] = &&do_jp_vx - &&do_decode,
+		[OP_LD_MEM] = &&do_ld_mem_keep - &&do_decode,
+		[OP_LD_REG_MEM] = &&do_ld_reg_mem_keep - &&do_decode,
+	};
+	Instr *in = NULL;
+	u16 address;
+
+	while (left > 0 && (m->PC & 1))
+	{
+		machine_step(m);
+		left--;
+	}
+	if (left == 0)
+	{
+		return;
+	}
+	left--;
+	address = m->PC & 0xFFF;
+	in = &m->code[address >> 1];
+	m->PC++;
+	goto *(&&do_decode + in->target);
+
+do_decode:
+	instr_decode(in, (m->memory[address] << 8) | m->memory[address + 1]);
+	in->target = (op_quirk(in->op) & m->quirks) ? quirked[in->op] : targets[in->op];
+	goto *(&&do_decode + in->target);
+do_cls:
+	op_cls(m, in);
+	NEXT();
+do_ret:
+	op_ret(m, in);
+	NEXT();
+do_sys:
+	op_sys(m, in);
+	NEXT();
+do_jp:
+	op_jp(m, in);
+	NEXT();
+do_call:
+	op_call(m, in);
+	NEXT();
+do_se_byte:
+	op_se_byte(m, in);
+	NEXT();
+do_sne_byte:
+	op_sne_byte(m, in);
+	NEXT();
+do_se_reg:
+	op_se_reg(m, in);
+	NEXT();
+do_ld_byte:
+	op_ld_byte(m, in);
+	NEXT();
+do_add_byte:
+	op_add_byte(m, in);
+	NEXT();
+do_ld_reg:
+	op_ld_reg(m, in);
+	NEXT();
+do_or:
+	op_or(m, in);
+	NEXT();
+do_and:
+	op_and(m, in);
+	NEXT();
+do_xor:
+	op_xor(m, in);
+	NEXT();
+do_add_reg:
+	op_add_reg(m, in);
+	NEXT();
+do_sub:
+	op_sub(m, in);
+	NEXT();
+do_shr:
+	op_shr(m, in, 0);
+	NEXT();
+do_shr_vy:
+	op_shr(m, in, QUIRK_SHIFT_VY);
+	NEXT();
+do_subn:
+	op_subn(m, in);
+	NEXT();
+do_shl:
+	op_shl(m, in, 0);
+	NEXT();
+do_shl_vy:
+	op_shl(m, in, QUIRK_SHIFT_VY);
+	NEXT();
+do_sne_reg:
+	op_sne_reg(m, in);
+	NEXT();
+do_ld_i:
+	op_ld_i(m, in);
+	NEXT();
+do_jp_v0:
+	op_jp_v0(m, in, 0);
+	NEXT();
+do_jp_vx:
+	op_jp_v0(m, in, QUIRK_JUMP_VX);
+	NEXT();
+do_rnd:
+	op_rnd(m, in);
+	NEXT();
+do_drw:
+	op_drw(m, in);
+	NEXT();
+do_skp:
+	op_skp(m, in);
+	NEXT();
+do_sknp:
+	op_sknp(m, in);
+	NEXT();
+do_ld_vx_dt:
+	op_ld_vx_dt(m, in);
+	NEXT();
+do_ld_key:
+	op_ld_key(m, in);
+	NEXT();
+do_ld_dt:
+	op_ld_dt(m, in);
+	NEXT();
+do_ld_st:
+	op_ld_st(m, in);
+	NEXT();
+do_add_i:
+	op_add_i(m, in);
+	NEXT();
+do_ld_f:
+	op_ld_f(m, in);
+	NEXT();
+do_ld_b:
+	op_ld_b(m, in);
+	NEXT();
+do_ld_mem:
+	op_ld_mem(m, in, 0);
+	NEXT();
+do_ld_mem_keep:
+	op_ld_mem(m, in, QUIRK_KEEP_I);
+	NEXT();
+do_ld_reg_mem:
+	op_ld_reg_mem(m, in, 0);
+	NEXT();
+do_ld_reg_mem_keep:
+	op_ld_reg_mem(m, in, QUIRK_KEEP_I);
+	NEXT();
+do_scd:
+	op_scd(m, in);
+	NEXT();
+do_scr:
+	op_scr(m, in);
+	NEXT();
+do_scl:
+	op_scl(m, in);
+	NEXT();
+do_exit:
+	op_exit(m, in);
+	NEXT();
+do_low:
+	op_low(m, in);
+	NEXT();
+do_high:
+	op_high(m, in);
+	NEXT();
+do_ld_hf:
+	op_ld_hf(m, in);
+	NEXT();
+do_ld_r:
+	op_ld_r(m, in);
+	NEXT();
+do_ld_vx_r:
+	op_ld_vx_r(m, in);
+	NEXT();
+do_none:
+	op_none(m, in);
+	NEXT();
+}
+
+#else
+
+// The ops that depend on the quirks, once for each way of doing them
+
+static void shr (Machine *m, Instr *in) { op_shr(m, in, 0); }
+static void shr_vy (Machine *m, Instr *in) { op_shr(m, in, QUIRK_SHIFT_VY); }
+static void shl (Machine *m, Instr *in) { op_shl(m, in, 0); }
+static void shl_vy (Machine *m, Instr *in) { op_shl(m, in, QUIRK_SHIFT_VY); }
+static void jp_v0 (Machine *m, Instr *in) { op_jp_v0(m, in, 0); }
+static void jp_vx (Machine *m, Instr *in) { op_jp_v0(m, in, QUIRK_JUMP_VX); }
+static void ld_mem (Machine *m, Instr *in) { op_ld_mem(m, in, 0); }
+static void ld_mem_keep (Machine *m, Instr *in) { op_ld_mem(m, in, QUIRK_KEEP_I); }
+static void ld_reg_mem (Machine *m, Instr *in) { op_ld_reg_mem(m, in, 0); }
+static void ld_reg_mem_keep (Machine *m, Instr *in) { op_ld_reg_mem(m, in, QUIRK_KEEP_I); }
+
+// Here target is 1 more than the row, 2 when decoding found the quirk of the op set
+
+#define HANDLERS(shr, shl, jp_v0, ld_mem, ld_reg_mem) \
+{ \
+	[OP_CLS] = op_cls, \
+	[OP_RET] = op_ret, \
+	[OP_SYS] = op_sys, \
+	[OP_JP] = op_jp, \
+	[OP_CALL] = op_call, \
+	[OP_SE_BYTE] = op_se_byte, \
+	[OP_SNE_BYTE] = op_sne_byte, \
+	[OP_SE_REG] = op_se_reg, \
+	[OP_LD_BYTE] = op_ld_byte, \
+	[OP_ADD_BYTE] = op_add_byte, \
+	[OP_LD_REG] = op_ld_reg, \
+	[OP_OR] = op_or, \
+	[OP_AND] = op_and, \
+	[OP_XOR] = op_xor, \
+	[OP_ADD_REG] = op_add_reg, \
+	[OP_SUB] = op_sub, \
+	[OP_SHR] = shr, \
+	[OP_SUBN] = op_subn, \
+	[OP_SHL] = shl, \
+	[OP_SNE_REG] = op_sne_reg, \
+	[OP_LD_I] = op_ld_i, \
+	[OP_JP_V0] = jp_v0, \
+	[OP_RND] = op_rnd, \
+	[OP_DRW] = op_drw, \
+	[OP_SKP] = op_skp, \
+	[OP_SKNP] = op_sknp, \
+	[OP_LD_VX_DT] = op_ld_vx_dt, \
+	[OP_LD_KEY] = op_ld_key, \
+	[OP_LD_DT] = op_ld_dt, \
+	[OP_LD_ST] = op_ld_st, \
+	[OP_ADD_I] = op_add_i, \
+	[OP_LD_F] = op_ld_f, \
+	[OP_LD_B] = op_ld_b, \
+	[OP_LD_MEM] = ld_mem, \
+	[OP_LD_REG_MEM] = ld_reg_mem, \
+	[OP_SCD] = op_scd, \
+	[OP_SCR] = op_scr, \
+	[OP_SCL] = op_scl, \
+	[OP_EXIT] = op_exit, \
+	[OP_LOW] = op_low, \
+	[OP_HIGH] = op_high, \
+	[OP_LD_HF] = op_ld_hf, \
+	[OP_LD_R] = op_ld_r, \
+	[OP_LD_VX_R] = op_ld_vx_r, \
+	[OP_NONE] = op_none \
+}
+
+static void (* const handlers[2][OP_COUNT]) (Machine *m, Instr *in) =
+{
+	HANDLERS(shr, shl, jp_v0, ld_mem, ld_reg_mem),
+	HANDLERS(shr_vy, shl_vy, jp_vx, ld_mem_keep, ld_reg_mem_keep)
+};
+
+void threaded_run (Machine *m, unsigned int left)
+{
+	Instr *in;
+	u16 address;
+
+	while (left > 0)
+	{
+		if (m->PC & 1)
+		{
+			machine_step(m);
+		}
+		else
+		{
+			address = m->PC & 0xFFF;
+			in = &m->code[address >> 1];
+			if (in->target == 0)
+			{
+				// Decoded here or by another engine, the row is picked once
+				if (in->op == OP_DECODE)
+				{
+					instr_decode(in, (m->memory[address] << 8) | m->memory[address + 1]);
+				}
+				in->target = 1 + ((op_quirk(in->op) & m->quirks) != 0);
+			}
+			m->PC++;
+			handlers[in->target - 1][in->op](m, in);
+			m->IR = in->ir;
+		}
+		left--;
+	}
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+#include "trace.h"
+#include "ops.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+Trace *trace_open (char *file_name, unsigned long rom)
+{
+	Trace *t;
+	
+	t = malloc(sizeof(Trace));
+	if (t == NULL)
+	{
+		return NULL;
+	}
+	t->fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if (t->fd < 0)
+	{
+		free(t);
+		return NULL;
+	}
+	t->head = 0;
+	t->rom = rom;
+	t->kept = 0;
+	return t;
+}
+
+void trace_step (Machine *m)
+{
+	// machine_step, leaving a record of what it did
+	
+	Trace *t = m->trace;
+	TraceRecord *r = &t->ring[t->head & (TRACE_SIZE - 1)];
+	Instr in;
+	u8 before[16];
+	u8 k;
+	
+	memcpy(before, m->V, sizeof(before));
+	r->pc = m->PC & 0xFFF;
+	m->IR = m->memory[m->PC++ & 0xFFF];
+	m->IR = ((m->IR << 8) | m->memory[m->PC & 0xFFF]);
+	r->ir = m->IR;
+	r->i = m->I;
+	r->reg = TRACE_NONE;
+	r->value = 0;
+	
+	// In the ring before it runs, an instruction that stops the machine is the last one dumped
+	__atomic_store_n(&t->head, t->head + 1, __ATOMIC_RELEASE);
+	instruction_execute(m);
+	
+	r->i = m->I;
+	if (memcmp(before, m->V, sizeof(before)) != 0)
+	{
+		for (k = 0; k < 16; k++)
+		{
+			if (m->V[k] == before[k])
+			{
+				continue;
+			}
+			if (r->reg != TRACE_NONE)
+			{
+				r->reg |= TRACE_MORE;
+				break;
+			}
+			r->reg = k;
+			r->value = m->V[k];
+		}
+	}
+	
+	// The first opcode that is not an instruction, SYS and the holes in the
+	// 8, E and F groups, leaves the ring ending at it for good
+	
+	instr_decode(&in, r->ir);
+	if (!t->kept && (in.op == OP_NONE || in.op == OP_SYS))
+	{
+		fprintf(stderr, "Unknown opcode 0x%04X at 0x%03X, trace written\n", r->ir, r->pc);
+		trace_dump(t);
+		t->kept = 1;
+	}
+}
+
+static void put16 (u8 *p, u16 v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32 (u8 *p, u32 v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+int trace_dump (Trace *t)
+{
+	// Only write, also called from a signal handler
+	
+	u8 buffer[512 * TRACE_RECORD];
+	u32 head, count, i, n;
+	TraceRecord *r;
+	
+	head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+	count = head < TRACE_SIZE ? head : TRACE_SIZE;
+	
+	memset(buffer, 0, 16);
+	memcpy(buffer, "C8TR", 4);
+	buffer[4] = TRACE_VERSION;
+	put32(buffer + 8, t->rom);
+	put32(buffer + 12, count);
+	if (lseek(t->fd, 0, SEEK_SET) != 0 || ftruncate(t->fd, 0) != 0 || write(t->fd, buffer, 16) != 16)
+	{
+		return 0;
+	}
+	
+	for (i = head - count, n = 0; i != head; i++)
+	{
+		r = &t->ring[i & (TRACE_SIZE - 1)];
+		put16(buffer + n, r->pc);
+		put16(buffer + n + 2, r->ir);
+		put16(buffer + n + 4, r->i);
+		buffer[n + 6] = r->reg;
+		buffer[n + 7] = r->value;
+		n += TRACE_RECORD;
+		if (n == sizeof(buffer) || i + 1 == head)
+		{
+			if (write(t->fd, buffer, n) != (ssize_t)n)
+			{
+				return 0;
+			}
+			n = 0;
+		}
+	}
+	return 1;
+}
+
+static Trace *caught;
+
+static void trace_crash (int sig)
+{
+	// Leave the trace behind and crash as it would have
+	
+	if (caught != NULL)
+	{
+		trace_dump(caught);
+	}
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+void trace_catch (Trace *t)
+{
+	// Dump t if the process crashes
+	
+	caught = t;
+	signal(SIGSEGV, trace_crash);
+	signal(SIGILL, trace_crash);
+	signal(SIGFPE, trace_crash);
+	signal(SIGABRT, trace_crash);
+#ifdef SIGBUS
+	signal(SIGBUS, trace_crash);
+#endif
+}
+
+void trace_close (Trace *t)
+{
+	// Dumps what is in the ring
+	
+	if (caught == t)
+	{
+		caught = NULL;
+	}
+	if (!t->kept)
+	{
+		trace_dump(t);
+	}
+	close(t->fd);
+	free(t);
+}
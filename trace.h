@@ -0,0 +1,85 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "machine.h"
+
+/*
+
+Execution trace
+
+While m->trace is set, every instruction run leaves a record of 8 bytes in
+a ring that keeps the last TRACE_SIZE of them: where it was fetched, the
+opcode, the register it changed and what I was left at. Writing a record is
+a store and moving the head, so it can stay on while playing. Only the
+writer moves the head, readers take it and then the records behind it, so
+no locks are needed, not even from a signal handler.
+
+The ring is written to its file when the run ends and on a crash
+(trace_catch), without running anything again. chip8-trace turns the file
+back into instructions. An opcode that is not an instruction (0nnn other
+than the ones known, and the holes in the 8, E and F groups) runs as
+nothing, as without tracing, but the ring is written right after it and
+kept that way at the end, so the file ends at the first of them.
+
+The instructions are recorded by machine_step, so while tracing every
+engine runs as the switch one. Loops worked out at once by machine_idle are
+not run and so leave no records.
+
+On disk, all numbers little endian:
+
+	"C8TR"			magic
+	version			1 byte, TRACE_VERSION
+	unused			3 bytes
+	rom			4 bytes, hash of the game
+	count			4 bytes, records that follow, oldest first
+	records			count x 8 bytes:
+		PC		2 bytes, where the opcode was fetched
+		IR		2 bytes
+		I		2 bytes, after it ran
+		register	1 byte, the lowest V changed, TRACE_NONE for
+				none, with TRACE_MORE if others changed too
+		value		1 byte, its new value
+
+*/
+
+// Records kept, a power of 2
+
+#define TRACE_SIZE 65536
+
+#define TRACE_VERSION 1
+#define TRACE_RECORD 8
+
+#define TRACE_NONE 0xFF
+#define TRACE_MORE 0x10
+
+typedef struct TraceRecord
+{
+	u16 pc;
+	u16 ir;
+	u16 i;
+	u8 reg;
+	u8 value;
+} TraceRecord;
+
+struct Trace
+{
+	TraceRecord ring[TRACE_SIZE];
+	
+	// Records ever written, the next one goes to head % TRACE_SIZE
+	u32 head;
+	
+	// Where it is dumped, opened at the start so a crash only has to write
+	int fd;
+	unsigned long rom;
+	
+	// Written at an unknown opcode, not again when the run ends
+	int kept;
+};
+
+Trace *trace_open (char *file_name, unsigned long rom);
+void trace_step (Machine *m);
+int trace_dump (Trace *t);
+void trace_catch (Trace *t);
+void trace_close (Trace *t);
+
+#endif
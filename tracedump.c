@@ -0,0 +1,117 @@
+/*
+
+The MIT License
+
+Copyright (c) 2009 Facon
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+
+*/
+
+/*
+
+Trace decoder
+
+Reads a file written by -trace (see trace.h) and prints one instruction
+per line, oldest first. The first column counts back from the end, -1 is
+the last instruction run, the one that crashed if it did.
+
+	-1  0x2DE  12DE  JP 0x2DE            I=0x310
+
+*/
+
+#include "trace.h"
+#include "disasm.h"
+
+static u16 get16 (u8 *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static u32 get32 (u8 *p)
+{
+	return get16(p) | (u32)get16(p + 2) << 16;
+}
+
+void usage(char *name)
+{
+	printf("Usage: %s [-last n] file\n", name);
+	printf("  -last n        only the last n instructions\n");
+}
+
+int main(int argv, char *argc[])
+{
+	FILE *file;
+	char *file_name = NULL;
+	char text[DISASM_MAX];
+	u8 header[16], record[TRACE_RECORD];
+	u32 count, last = 0, i;
+	int arg;
+	u8 reg;
+	
+	for (arg = 1; arg < argv; arg++)
+	{
+		if (strcmp(argc[arg], "-last") == 0 && arg + 1 < argv)
+		{
+			last = strtoul(argc[++arg], NULL, 10);
+		}
+		else if (argc[arg][0] == '-')
+		{
+			usage(argc[0]);
+			return 1;
+		}
+		else
+		{
+			file_name = argc[arg];
+		}
+	}
+	if (file_name == NULL)
+	{
+		usage(argc[0]);
+		return 1;
+	}
+	
+	file = fopen(file_name, "rb");
+	if (file == NULL)
+	{
+		printf("Error, not found %s.\n", file_name);
+		return 1;
+	}
+	if (fread(header, 1, 16, file) != 16 || memcmp(header, "C8TR", 4) != 0 || header[4] != TRACE_VERSION)
+	{
+		printf("Error, %s is not a trace.\n", file_name);
+		fclose(file);
+		return 1;
+	}
+	count = get32(header + 12);
+	printf("Trace of rom 0x%08X, %u instructions\n", get32(header + 8), count);
+	
+	if (last != 0 && last < count)
+	{
+		fseek(file, (long)(count - last) * TRACE_RECORD, SEEK_CUR);
+		count = last;
+	}
+	for (i = count; i > 0; i--)
+	{
+		if (fread(record, 1, TRACE_RECORD, file) != TRACE_RECORD)
+		{
+			printf("Error, %s ends too soon.\n", file_name);
+			fclose(file);
+			return 1;
+		}
+		disasm(get16(record + 2), text);
+		printf("%7ld  0x%03X  %04X  %-18s  I=0x%03X", -(long)i, get16(record), get16(record + 2), text, get16(record + 4));
+		reg = record[6];
+		if (reg != TRACE_NONE)
+		{
+			printf("  V%X=0x%02X%s", reg & 0xF, record[7], (reg & TRACE_MORE) ? " +" : "");
+		}
+		putchar('\n');
+	}
+	fclose(file);
+	return 0;
+}